@@ -28,6 +28,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <stddef.h>
 
 #include "config.h"
 #include "int64.h"
@@ -1170,6 +1171,22 @@ int ataReadLogDirectory(ata_device * device, ata_smart_log_directory * data, boo
   return 0;
 }
 
+// Get # sectors of a log addr, 0 if log does not exist.
+unsigned ataGetNumLogSectors(const ata_smart_log_directory * logdir, unsigned logaddr, bool gpl)
+{
+  if (!logdir)
+    return 0;
+  if (logaddr > 0xff)
+    return 0;
+  if (logaddr == 0)
+    return 1;
+  unsigned n = logdir->entry[logaddr-1].numsectors;
+  if (gpl)
+    // GP logs may have >255 sectors
+    n |= logdir->entry[logaddr-1].reserved << 8;
+  return n;
+}
+
 
 // Reads the selective self-test log (log #9)
 int ataReadSelectiveSelfTestLog(ata_device * device, struct ata_selective_self_test_log *data){
@@ -1873,11 +1890,9 @@ ata_attr_state ata_get_attr_state(const ata_smart_attribute & attr,
   return ATTRSTATE_OK;
 }
 
-// Get attribute raw value.
-uint64_t ata_get_attr_raw_value(const ata_smart_attribute & attr,
-                                const ata_vendor_attr_defs & defs)
+// Get byte order of attribute raw value.
+static const char * get_attr_byteorder(const ata_vendor_attr_defs::entry & def)
 {
-  const ata_vendor_attr_defs::entry & def = defs[attr.id];
   // TODO: Allow Byteorder in DEFAULT entry
 
   // Use default byteorder if not specified
@@ -1896,6 +1911,14 @@ uint64_t ata_get_attr_raw_value(const ata_smart_attribute & attr,
         byteorder = "543210"; break;
     }
   }
+  return byteorder;
+}
+
+// Get attribute raw value.
+uint64_t ata_get_attr_raw_value(const ata_smart_attribute & attr,
+                                const ata_vendor_attr_defs & defs)
+{
+  const char * byteorder = get_attr_byteorder(defs[attr.id]);
 
   // Build 64-bit value from selected bytes
   uint64_t rawvalue = 0;
@@ -2185,6 +2208,112 @@ int ata_find_attr_index(unsigned char id, const ata_smart_values & smartval)
   return -1;
 }
 
+// Clear plan, no attribute known.
+void ata_attr_plan::clear()
+{
+  memset(m_slots, 0, sizeof(m_slots));
+  memset(m_index, -1, sizeof(m_index));
+}
+
+// Resolve attribute slots of 'smartval'.
+void ata_attr_plan::init(const ata_smart_values & smartval,
+                         const ata_smart_threshold_entry * thresholds,
+                         const ata_vendor_attr_defs & defs)
+{
+  clear();
+  for (int i = 0; i < NUMBER_ATA_SMART_ATTRIBUTES; i++) {
+    unsigned char id = smartval.vendor_attributes[i].id;
+    if (!id)
+      continue;
+    slot & s = m_slots[i];
+    s.id = id;
+    if (m_index[id] < 0)
+      m_index[id] = i;
+
+    const ata_vendor_attr_defs::entry & def = defs[id];
+    s.flags = (unsigned char)def.flags;
+
+    // Normally threshold is at same index as attribute
+    int ti = i;
+    if (thresholds[ti].id != id) {
+      for (ti = 0; ti < NUMBER_ATA_SMART_ATTRIBUTES && thresholds[ti].id != id; ti++)
+        ;
+    }
+    if (ti < NUMBER_ATA_SMART_ATTRIBUTES) {
+      s.has_threshold = true;
+      s.threshold = thresholds[ti].threshold;
+    }
+
+    // Translate byte order into offsets, unknown bytes read as 0
+    const char * byteorder = get_attr_byteorder(def);
+    int n;
+    for (n = 0; byteorder[n] && n < (int)sizeof(s.offsets); n++) {
+      unsigned char off;
+      switch (byteorder[n]) {
+        case '0': case '1': case '2': case '3': case '4': case '5':
+          off = offsetof(ata_smart_attribute, raw) + (byteorder[n] - '0'); break;
+        case 'r': off = offsetof(ata_smart_attribute, reserv);  break;
+        case 'v': off = offsetof(ata_smart_attribute, current); break;
+        case 'w': off = offsetof(ata_smart_attribute, worst);   break;
+        default : off = 0xff; break;
+      }
+      s.offsets[n] = off;
+    }
+    s.num_bytes = n;
+  }
+}
+
+// Return true if all attribute ids are at the same index.
+bool ata_attr_plan::matches(const ata_smart_values & smartval) const
+{
+  for (int i = 0; i < NUMBER_ATA_SMART_ATTRIBUTES; i++) {
+    if (smartval.vendor_attributes[i].id != m_slots[i].id)
+      return false;
+  }
+  return true;
+}
+
+// Get attribute state, same as ata_get_attr_state().
+ata_attr_state ata_attr_plan::get_state(const ata_smart_attribute & attr,
+                                        int attridx,
+                                        unsigned char * threshval /* = 0 */) const
+{
+  if (!attr.id)
+    return ATTRSTATE_NON_EXISTING;
+
+  const slot & s = m_slots[attridx];
+  if (s.flags & ATTRFLAG_NO_NORMVAL)
+    return ATTRSTATE_NO_NORMVAL;
+  if (!s.has_threshold)
+    return ATTRSTATE_NO_THRESHOLD;
+
+  if (threshval)
+    *threshval = s.threshold;
+
+  // See ata_get_attr_state() for details
+  if (!s.threshold)
+    return ATTRSTATE_OK;
+  if (attr.current <= s.threshold)
+    return ATTRSTATE_FAILED_NOW;
+  if (!(s.flags & ATTRFLAG_NO_WORSTVAL) && attr.worst <= s.threshold)
+    return ATTRSTATE_FAILED_PAST;
+  return ATTRSTATE_OK;
+}
+
+// Get attribute raw value, same as ata_get_attr_raw_value().
+uint64_t ata_attr_plan::get_raw_value(const ata_smart_attribute & attr,
+                                      int attridx) const
+{
+  const slot & s = m_slots[attridx];
+  const unsigned char * p = reinterpret_cast<const unsigned char *>(&attr);
+  uint64_t rawvalue = 0;
+  for (int i = 0; i < s.num_bytes; i++) {
+    unsigned char off = s.offsets[i];
+    rawvalue <<= 8; rawvalue |= (off < sizeof(attr) ? p[off] : 0);
+  }
+  return rawvalue;
+}
+
 // Return Temperature Attribute raw value selected according to possible
 // non-default interpretations. If the Attribute does not exist, return 0
 unsigned char ata_return_temperature_value(const ata_smart_values * data, const ata_vendor_attr_defs & defs)
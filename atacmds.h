@@ -778,6 +778,8 @@ int ataReadSelfTestLog(ata_device * device, ata_smart_selftestlog * data,
                        firmwarebug_defs firmwarebugs);
 int ataReadSelectiveSelfTestLog(ata_device * device, struct ata_selective_self_test_log *data);
 int ataReadLogDirectory(ata_device * device, ata_smart_log_directory *, bool gpl);
+// Get # sectors of a log addr, 0 if log does not exist.
+unsigned ataGetNumLogSectors(const ata_smart_log_directory * logdir, unsigned logaddr, bool gpl);
 
 // Read GP Log page(s)
 bool ataReadLogExt(ata_device * device, unsigned char logaddr,
@@ -930,6 +932,56 @@ int ata_find_attr_index(unsigned char id, const ata_smart_values & smartval);
 // non-default interpretations. If the Attribute does not exist, return 0
 unsigned char ata_return_temperature_value(const ata_smart_values * data, const ata_vendor_attr_defs & defs);
 
+// Attribute evaluation plan for one drive.
+// Threshold entries, attribute flags and raw value byte orders are
+// resolved once by init().  Later checks of the same attribute table
+// need no threshold table search and no vendor attribute def lookup.
+class ata_attr_plan
+{
+public:
+  ata_attr_plan()
+    { clear(); }
+
+  // Clear plan, no attribute known.
+  void clear();
+
+  // Resolve attribute slots of 'smartval'.
+  void init(const ata_smart_values & smartval,
+            const ata_smart_threshold_entry * thresholds,
+            const ata_vendor_attr_defs & defs);
+
+  // Return true if all attribute ids of 'smartval' are at the same
+  // index as during init().
+  bool matches(const ata_smart_values & smartval) const;
+
+  // Find attribute index for attribute id, -1 if not found.
+  int find_index(unsigned char id) const
+    { return (id ? m_index[id] : -1); }
+
+  // Get attribute state, same as ata_get_attr_state().
+  // The id of 'attr' must match the id at 'attridx'.
+  ata_attr_state get_state(const ata_smart_attribute & attr, int attridx,
+                           unsigned char * threshval = 0) const;
+
+  // Get attribute raw value, same as ata_get_attr_raw_value().
+  // The id of 'attr' must match the id at 'attridx'.
+  uint64_t get_raw_value(const ata_smart_attribute & attr, int attridx) const;
+
+private:
+  struct slot
+  {
+    unsigned char id;          // Attribute id, 0 if none
+    bool has_threshold;        // False if threshold id is missing
+    unsigned char threshold;   // Threshold value
+    unsigned char flags;       // ATTRFLAG_*
+    unsigned char num_bytes;   // Number of raw value bytes
+    unsigned char offsets[8];  // Byte offsets into ata_smart_attribute
+  };
+
+  slot m_slots[NUMBER_ATA_SMART_ATTRIBUTES];
+  signed char m_index[256];
+};
+
 
 #define MAX_ATTRIBUTE_NUM 256
 
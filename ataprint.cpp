@@ -983,13 +983,12 @@ static void PrintSmartConveyanceSelfTestPollingTime(const ata_smart_values * dat
 // onlyfailed=0: are or were any age or prefailure attributes <= threshold
 // onlyfailed=1: are any prefailure attributes <= threshold now
 static int find_failed_attr(const ata_smart_values * data,
-                            const ata_smart_thresholds_pvt * thresholds,
-                            const ata_vendor_attr_defs & defs, int onlyfailed)
+                            const ata_attr_plan & plan, int onlyfailed)
 {
   for (int i = 0; i < NUMBER_ATA_SMART_ATTRIBUTES; i++) {
     const ata_smart_attribute & attr = data->vendor_attributes[i];
 
-    ata_attr_state state = ata_get_attr_state(attr, i, thresholds->thres_entries, defs);
+    ata_attr_state state = plan.get_state(attr, i);
 
     if (!onlyfailed) {
       if (state >= ATTRSTATE_FAILED_PAST)
@@ -1007,7 +1006,7 @@ static int find_failed_attr(const ata_smart_values * data,
 // onlyfailed=1:  just ones that are currently failed and have prefailure bit set
 // onlyfailed=2:  ones that are failed, or have failed with or without prefailure bit set
 static void PrintSmartAttribWithThres(const ata_smart_values * data,
-                                      const ata_smart_thresholds_pvt * thresholds,
+                                      const ata_attr_plan & plan,
                                       const ata_vendor_attr_defs & defs, int rpm,
                                       int onlyfailed, unsigned char format)
 {
@@ -1022,7 +1021,7 @@ static void PrintSmartAttribWithThres(const ata_smart_values * data,
 
     // Check attribute and threshold
     unsigned char threshold = 0;
-    ata_attr_state state = ata_get_attr_state(attr, i, thresholds->thres_entries, defs, &threshold);
+    ata_attr_state state = plan.get_state(attr, i, &threshold);
     if (state == ATTRSTATE_NON_EXISTING)
       continue;
 
@@ -1164,22 +1163,6 @@ static void PrintGeneralSmartValues(const ata_smart_values *data, const ata_iden
   pout("\n");
 }
 
-// Get # sectors of a log addr, 0 if log does not exist.
-static unsigned GetNumLogSectors(const ata_smart_log_directory * logdir, unsigned logaddr, bool gpl)
-{
-  if (!logdir)
-    return 0;
-  if (logaddr > 0xff)
-    return 0;
-  if (logaddr == 0)
-    return 1;
-  unsigned n = logdir->entry[logaddr-1].numsectors;
-  if (gpl)
-    // GP logs may have >255 sectors
-    n |= logdir->entry[logaddr-1].reserved << 8;
-  return n;
-}
-
 // Get name of log.
 static const char * GetLogName(unsigned logaddr)
 {
@@ -1289,8 +1272,8 @@ static void PrintLogDirectories(const ata_smart_log_directory * gplogdir,
 
   for (unsigned i = 0; i <= 0xff; i++) {
     // Get number of sectors
-    unsigned smart_numsect = GetNumLogSectors(smartlogdir, i, false);
-    unsigned gp_numsect    = GetNumLogSectors(gplogdir   , i, true );
+    unsigned smart_numsect = ataGetNumLogSectors(smartlogdir, i, false);
+    unsigned gp_numsect    = ataGetNumLogSectors(gplogdir   , i, true );
 
     if (!(smart_numsect || gp_numsect))
       continue; // Log does not exist
@@ -1314,8 +1297,8 @@ static void PrintLogDirectories(const ata_smart_log_directory * gplogdir,
       // Find range of Host/Device vendor specific logs with same size
       unsigned imax = (i < 0x9f ? 0x9f : 0xdf);
       for (unsigned j = i+1; j <= imax; j++) {
-          unsigned sn = GetNumLogSectors(smartlogdir, j, false);
-          unsigned gn = GetNumLogSectors(gplogdir   , j, true );
+          unsigned sn = ataGetNumLogSectors(smartlogdir, j, false);
+          unsigned gn = ataGetNumLogSectors(gplogdir   , j, true );
 
           if (!(sn == smart_numsect && gn == gp_numsect))
             break;
@@ -1628,9 +1611,9 @@ static bool print_device_statistics(ata_device * device, unsigned nsectors,
           max_page = page;
       }
 
-    raw_buffer pages_buf((max_page+1) * 512);
+    unsigned char * pages_buf = device->get_io_buffer((max_page+1) * 512);
 
-    if (!use_gplog && !ataReadSmartLog(device, 0x04, pages_buf.data(), max_page+1)) {
+    if (!use_gplog && !ataReadSmartLog(device, 0x04, pages_buf, max_page+1)) {
       pout("Read Device Statistics pages 0x00-0x%02x failed\n\n", max_page);
       return false;
     }
@@ -1638,7 +1621,7 @@ static bool print_device_statistics(ata_device * device, unsigned nsectors,
     for (i = 0; i <  pages.size(); i++) {
       int page = pages[i];
       if (use_gplog) {
-        if (!ataReadLogExt(device, 0x04, 0, page, pages_buf.data(), 1)) {
+        if (!ataReadLogExt(device, 0x04, 0, page, pages_buf, 1)) {
           pout("Read Device Statistics page 0x%02x failed\n\n", page);
           return false;
         }
@@ -1647,7 +1630,7 @@ static bool print_device_statistics(ata_device * device, unsigned nsectors,
         continue;
 
       int offset = (use_gplog ? 0 : page * 512);
-      print_device_statistics_page(pages_buf.data() + offset, page);
+      print_device_statistics_page(pages_buf + offset, page);
     }
 
     pout("%32s|||_ C monitored condition met\n", "");
@@ -3049,6 +3032,11 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
     smart_val_ok = false;
   }
 
+  // Resolve thresholds and attribute defs once for all checks below
+  ata_attr_plan attrplan;
+  if (smart_val_ok)
+    attrplan.init(smartval, smartthres.thres_entries, attribute_defs);
+
   // all this for a newline!
   if (   options.smart_disable           || options.smart_enable
       || options.smart_auto_save_disable || options.smart_auto_save_enable
@@ -3074,13 +3062,13 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
     case 0:
       // The case where the disk health is OK
       pout("SMART overall-health self-assessment test result: PASSED\n");
-      if (smart_thres_ok && find_failed_attr(&smartval, &smartthres, attribute_defs, 0)) {
+      if (smart_thres_ok && find_failed_attr(&smartval, attrplan, 0)) {
         if (options.smart_vendor_attrib)
           pout("See vendor-specific Attribute list for marginal Attributes.\n\n");
         else {
           print_on();
           pout("Please note the following marginal Attributes:\n");
-          PrintSmartAttribWithThres(&smartval, &smartthres, attribute_defs, rpm, 2, options.output_format);
+          PrintSmartAttribWithThres(&smartval, attrplan, attribute_defs, rpm, 2, options.output_format);
         } 
         returnval|=FAILAGE;
       }
@@ -3094,14 +3082,14 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
       pout("SMART overall-health self-assessment test result: FAILED!\n"
            "Drive failure expected in less than 24 hours. SAVE ALL DATA.\n");
       print_off();
-      if (smart_thres_ok && find_failed_attr(&smartval, &smartthres, attribute_defs, 1)) {
+      if (smart_thres_ok && find_failed_attr(&smartval, attrplan, 1)) {
         returnval|=FAILATTR;
         if (options.smart_vendor_attrib)
           pout("See vendor-specific Attribute list for failed Attributes.\n\n");
         else {
           print_on();
           pout("Failed Attributes:\n");
-          PrintSmartAttribWithThres(&smartval, &smartthres, attribute_defs, rpm, 1, options.output_format);
+          PrintSmartAttribWithThres(&smartval, attrplan, attribute_defs, rpm, 1, options.output_format);
         }
       }
       else
@@ -3126,7 +3114,7 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
         pout("SMART overall-health self-assessment test result: UNKNOWN!\n"
              "SMART Status, Attributes and Thresholds cannot be read.\n\n");
       }
-      else if (find_failed_attr(&smartval, &smartthres, attribute_defs, 1)) {
+      else if (find_failed_attr(&smartval, attrplan, 1)) {
         print_on();
         pout("SMART overall-health self-assessment test result: FAILED!\n"
              "Drive failure expected in less than 24 hours. SAVE ALL DATA.\n");
@@ -3139,19 +3127,19 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
         else {
           print_on();
           pout("Failed Attributes:\n");
-          PrintSmartAttribWithThres(&smartval, &smartthres, attribute_defs, rpm, 1, options.output_format);
+          PrintSmartAttribWithThres(&smartval, attrplan, attribute_defs, rpm, 1, options.output_format);
         }
       }
       else {
         pout("SMART overall-health self-assessment test result: PASSED\n");
         pout("Warning: This result is based on an Attribute check.\n");
-        if (find_failed_attr(&smartval, &smartthres, attribute_defs, 0)) {
+        if (find_failed_attr(&smartval, attrplan, 0)) {
           if (options.smart_vendor_attrib)
             pout("See vendor-specific Attribute list for marginal Attributes.\n\n");
           else {
             print_on();
             pout("Please note the following marginal Attributes:\n");
-            PrintSmartAttribWithThres(&smartval, &smartthres, attribute_defs, rpm, 2, options.output_format);
+            PrintSmartAttribWithThres(&smartval, attrplan, attribute_defs, rpm, 2, options.output_format);
           } 
           returnval|=FAILAGE;
         }
@@ -3172,7 +3160,7 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
   // Print vendor-specific attributes
   if (smart_val_ok && options.smart_vendor_attrib) {
     print_on();
-    PrintSmartAttribWithThres(&smartval, &smartthres, attribute_defs, rpm,
+    PrintSmartAttribWithThres(&smartval, attrplan, attribute_defs, rpm,
                               (printing_is_switchable ? 2 : 0), options.output_format);
     print_off();
   }
@@ -3232,11 +3220,11 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
     unsigned max_nsectors;
     if (req.gpl) {
       type = "General Purpose";
-      max_nsectors = GetNumLogSectors(gplogdir, req.logaddr, true);
+      max_nsectors = ataGetNumLogSectors(gplogdir, req.logaddr, true);
     }
     else {
       type = "SMART";
-      max_nsectors = GetNumLogSectors(smartlogdir, req.logaddr, false);
+      max_nsectors = ataGetNumLogSectors(smartlogdir, req.logaddr, false);
     }
 
     if (!max_nsectors) {
@@ -3261,23 +3249,23 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
     // SMART log don't support sector offset, start with first sector
     unsigned offs = (req.gpl ? 0 : req.page);
 
-    raw_buffer log_buf((offs + ns) * 512);
+    unsigned char * log_buf = device->get_io_buffer((offs + ns) * 512);
     bool ok;
     if (req.gpl)
-      ok = ataReadLogExt(device, req.logaddr, 0x00, req.page, log_buf.data(), ns);
+      ok = ataReadLogExt(device, req.logaddr, 0x00, req.page, log_buf, ns);
     else
-      ok = ataReadSmartLog(device, req.logaddr, log_buf.data(), offs + ns);
+      ok = ataReadSmartLog(device, req.logaddr, log_buf, offs + ns);
     if (!ok)
       failuretest(OPTIONAL_CMD, returnval|=FAILSMART);
     else
-      PrintLogPages(type, log_buf.data() + offs*512, req.logaddr, req.page, ns, max_nsectors);
+      PrintLogPages(type, log_buf + offs*512, req.logaddr, req.page, ns, max_nsectors);
   }
 
   // Print SMART Extendend Comprehensive Error Log
   bool do_smart_error_log = options.smart_error_log;
   if (options.smart_ext_error_log) {
     bool ok = false;
-    unsigned nsectors = GetNumLogSectors(gplogdir, 0x03, true);
+    unsigned nsectors = ataGetNumLogSectors(gplogdir, 0x03, true);
     if (!nsectors)
       pout("SMART Extended Comprehensive Error Log (GP Log 0x03) not supported\n\n");
     else {
@@ -3305,7 +3293,7 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
 
   // Print SMART error log
   if (do_smart_error_log) {
-    if (!(   GetNumLogSectors(smartlogdir, 0x01, false)
+    if (!(   ataGetNumLogSectors(smartlogdir, 0x01, false)
           || (   !(smartlogdir && gp_log_supported)
               && isSmartErrorLogCapable(&smartval, &drive))
           || is_permissive()                               )) {
@@ -3330,14 +3318,14 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
   bool do_smart_selftest_log = options.smart_selftest_log;
   if (options.smart_ext_selftest_log) {
     bool ok = false;
-    unsigned nsectors = GetNumLogSectors(gplogdir, 0x07, true);
+    unsigned nsectors = ataGetNumLogSectors(gplogdir, 0x07, true);
     if (!nsectors)
       pout("SMART Extended Self-test Log (GP Log 0x07) not supported\n\n");
     else if (nsectors >= 256)
       pout("SMART Extended Self-test Log size %u not supported\n\n", nsectors);
     else {
-      raw_buffer log_07_buf(nsectors * 512);
-      ata_smart_extselftestlog * log_07 = reinterpret_cast<ata_smart_extselftestlog *>(log_07_buf.data());
+      ata_smart_extselftestlog * log_07 = reinterpret_cast<ata_smart_extselftestlog *>(
+        device->get_io_buffer(nsectors * 512));
       if (!ataReadExtSelfTestLog(device, log_07, nsectors)) {
         pout("Read SMART Extended Self-test Log failed\n\n");
         failuretest(OPTIONAL_CMD, returnval|=FAILSMART);
@@ -3359,7 +3347,7 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
 
   // Print SMART self-test log
   if (do_smart_selftest_log) {
-    if (!(   GetNumLogSectors(smartlogdir, 0x06, false)
+    if (!(   ataGetNumLogSectors(smartlogdir, 0x06, false)
           || (   !(smartlogdir && gp_log_supported)
               && isSmartTestLogCapable(&smartval, &drive))
           || is_permissive()                              )) {
@@ -3522,9 +3510,9 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
     bool use_gplog = true;
     unsigned nsectors = 0;
     if (gplogdir) 
-      nsectors = GetNumLogSectors(gplogdir, 0x04, false);
+      nsectors = ataGetNumLogSectors(gplogdir, 0x04, false);
     else if (smartlogdir){ // for systems without ATA_READ_LOG_EXT
-      nsectors = GetNumLogSectors(smartlogdir, 0x04, false);
+      nsectors = ataGetNumLogSectors(smartlogdir, 0x04, false);
       use_gplog = false;
     }
     if (!nsectors)
@@ -3536,7 +3524,7 @@ int ataPrintMain (ata_device * device, const ata_print_options & options)
 
   // Print SATA Phy Event Counters
   if (options.sataphy) {
-    unsigned nsectors = GetNumLogSectors(gplogdir, 0x11, true);
+    unsigned nsectors = ataGetNumLogSectors(gplogdir, 0x11, true);
     // Packet interface devices do not provide a log directory, check support bit
     if (!nsectors && (drive.words047_079[76-47] & 0x0401) == 0x0400)
       nsectors = 1;
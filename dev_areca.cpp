@@ -289,19 +289,24 @@ int generic_areca_device::arcmsr_ui_handler(unsigned char *areca_packet, int are
       areca_packet[cs_pos] += areca_packet[i];
   }
 
-  if(!arcmsr_lock())
   {
-    return -1;
-  }
-  expected = arcmsr_command_handler(ARCMSR_CLEAR_RQBUFFER, NULL, 0);
-  if (expected==-3) {
-    return set_err(EIO);
-  }
-  arcmsr_command_handler(ARCMSR_CLEAR_WQBUFFER, NULL, 0);
-  expected = arcmsr_command_handler(ARCMSR_WRITE_WQBUFFER, areca_packet, areca_packet_len);
-  if ( expected > 0 )
-  {
-    expected = arcmsr_command_handler(ARCMSR_READ_RQBUFFER, return_buff, sizeof(return_buff));
+    // Controller stays locked until the reply is read,
+    // also on early return
+    controller_lock lock(this);
+    if(!lock.is_locked())
+    {
+      return -1;
+    }
+    expected = arcmsr_command_handler(ARCMSR_CLEAR_RQBUFFER, NULL, 0);
+    if (expected==-3) {
+      return set_err(EIO);
+    }
+    arcmsr_command_handler(ARCMSR_CLEAR_WQBUFFER, NULL, 0);
+    expected = arcmsr_command_handler(ARCMSR_WRITE_WQBUFFER, areca_packet, areca_packet_len);
+    if ( expected > 0 )
+    {
+      expected = arcmsr_command_handler(ARCMSR_READ_RQBUFFER, return_buff, sizeof(return_buff));
+    }
   }
 
   if ( expected < 3 + 1 ) // Prefix + Checksum
@@ -309,11 +314,6 @@ int generic_areca_device::arcmsr_ui_handler(unsigned char *areca_packet, int are
     return -1;
   }
 
-  if(!arcmsr_unlock())
-  {
-    return -1;
-  }
-
   // ----- VERIFY THE CHECKSUM -----
   cs = 0;
   for ( int loop = 3; loop < expected - 1; loop++ )
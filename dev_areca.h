@@ -117,6 +117,12 @@ public:
   virtual bool arcmsr_scsi_pass_through(scsi_cmnd_io * iop);
   virtual bool arcmsr_ata_pass_through(const ata_cmd_in & in, ata_cmd_out & out);
 
+  // Controller lock is provided by the OS-dependent functions
+  virtual bool lock_controller()
+    { return arcmsr_lock(); }
+  virtual bool unlock_controller()
+    { return arcmsr_unlock(); }
+
 protected:
   generic_areca_device()
     : smart_device(never_called),
@@ -19,6 +19,7 @@
 #include "int64.h"
 #include "dev_interface.h"
 #include "dev_tunnelled.h"
+#include "dev_sim.h"
 #include "atacmds.h" // ATA_SMART_CMD/STATUS
 #include "utility.h"
 
@@ -43,19 +44,23 @@ int smart_device::s_num_objects = 0;
 smart_device::smart_device(smart_interface * intf, const char * dev_name,
     const char * dev_type, const char * req_type)
 : m_intf(intf), m_info(dev_name, dev_type, req_type),
+  m_io_buf_raw(0), m_io_buf(0), m_io_buf_size(0),
   m_ata_ptr(0), m_scsi_ptr(0), m_nvme_ptr(0)
 {
   s_num_objects++;
 }
 
 smart_device::smart_device(do_not_use_in_implementation_classes)
-: m_intf(0), m_ata_ptr(0), m_scsi_ptr(0), m_nvme_ptr(0)
+: m_intf(0),
+  m_io_buf_raw(0), m_io_buf(0), m_io_buf_size(0),
+  m_ata_ptr(0), m_scsi_ptr(0), m_nvme_ptr(0)
 {
   throw std::logic_error("smart_device: wrong constructor called in implementation class");
 }
 
 smart_device::~smart_device() throw()
 {
+  delete [] m_io_buf_raw;
   s_num_objects--;
 }
 
@@ -106,6 +111,34 @@ void smart_device::release(const smart_device * /*dev*/)
 {
 }
 
+bool smart_device::lock_controller()
+{
+  return true;
+}
+
+bool smart_device::unlock_controller()
+{
+  return true;
+}
+
+unsigned char * smart_device::get_io_buffer(unsigned size, bool clear /* = true */)
+{
+  const unsigned page_size = 4096;
+  if (!m_io_buf || size > m_io_buf_size) {
+    // Allocate at least one page, round up to page size
+    unsigned new_size = (size > page_size ? (size + page_size - 1) & ~(page_size - 1)
+                                          : page_size);
+    unsigned char * raw = new unsigned char[new_size + page_size - 1];
+    delete [] m_io_buf_raw;
+    m_io_buf_raw = raw;
+    m_io_buf = raw + ((page_size - ((uintptr_t)raw & (page_size - 1))) & (page_size - 1));
+    m_io_buf_size = new_size;
+  }
+  if (clear)
+    memset(m_io_buf, 0, size);
+  return m_io_buf;
+}
+
 
 /////////////////////////////////////////////////////////////////////////////
 // ata_device
@@ -282,7 +315,7 @@ std::string smart_interface::get_valid_dev_types_str()
   // default
   std::string s =
     "ata, scsi, nvme[,NSID], sat[,auto][,N][+TYPE], "
-    "usbcypress[,X], usbjmicron[,p][,x][,N], usbprolific, usbsunplus";
+    "usbcypress[,X], usbjmicron[,p][,x][,N], usbprolific, usbsunplus, sim";
   // append custom
   std::string s2 = get_valid_custom_dev_types_str();
   if (!s2.empty()) {
@@ -372,6 +405,14 @@ smart_device * smart_interface::get_smart_device(const char * name, const char *
   // Call platform specific autodetection if no device type specified
   smart_device * dev;
   if (!type || !*type) {
+    // Use result of a previous autodetection if still valid
+    const char * cached_type = lookup_type_cache(name);
+    if (cached_type) {
+      dev = get_smart_device(name, cached_type);
+      if (dev)
+        return dev;
+      clear_err();
+    }
     dev = autodetect_smart_device(name);
     if (!dev && !get_errno())
       set_err(EINVAL, "Unable to detect device type");
@@ -388,6 +429,10 @@ smart_device * smart_interface::get_smart_device(const char * name, const char *
   else if (!strcmp(type, "scsi"))
     dev = get_scsi_device(name, type);
 
+  else if (!strcmp(type, "sim"))
+    // Simulated device, NAME is the response file
+    return get_sim_device(this, name, type);
+
   else if (str_starts_with(type, "nvme")) {
     int n1 = -1, n2 = -1, len = strlen(type);
     unsigned nsid = 0; // invalid namespace id -> use default
@@ -450,6 +495,123 @@ bool smart_interface::scan_smart_devices(smart_device_list & devlist,
   return true;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// Device type cache
+
+std::string smart_interface::get_type_cache_key(const char * /*name*/)
+{
+  return "";
+}
+
+// Read cache file "NAME<TAB>KEY<TAB>TYPE" lines once
+void smart_interface::read_type_cache()
+{
+  if (m_type_cache_read)
+    return;
+  m_type_cache_read = true;
+  m_type_cache.clear();
+
+  stdio_file f(m_type_cache_file.c_str(), "r");
+  if (!f)
+    return;
+  char line[1024];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#')
+      continue;
+    line[strcspn(line, "\r\n")] = 0;
+    char * t1 = strchr(line, '\t');
+    char * t2 = (t1 ? strrchr(t1 + 1, '\t') : 0);
+    if (!t2 || !t2[1])
+      continue;
+    *t1 = *t2 = 0;
+    type_cache_entry e;
+    e.name = line; e.key = t1 + 1; e.type = t2 + 1;
+    m_type_cache.push_back(e);
+  }
+}
+
+bool smart_interface::write_type_cache()
+{
+  stdio_file f(m_type_cache_file.c_str(), "w");
+  if (!f)
+    return false;
+  fprintf(f, "# smartmontools device type cache, do not edit\n");
+  for (unsigned i = 0; i < m_type_cache.size(); i++) {
+    const type_cache_entry & e = m_type_cache[i];
+    fprintf(f, "%s\t%s\t%s\n", e.name.c_str(), e.key.c_str(), e.type.c_str());
+  }
+  return f.close();
+}
+
+const char * smart_interface::lookup_type_cache(const char * name)
+{
+  if (m_type_cache_file.empty())
+    return 0;
+  read_type_cache();
+  if (m_type_cache.empty())
+    return 0;
+  std::string key = get_type_cache_key(name);
+  if (key.empty())
+    return 0;
+  for (unsigned i = 0; i < m_type_cache.size(); i++) {
+    const type_cache_entry & e = m_type_cache[i];
+    if (e.name == name && e.key == key)
+      return e.type.c_str();
+  }
+  return 0;
+}
+
+bool smart_interface::update_type_cache(const smart_device * dev)
+{
+  if (m_type_cache_file.empty() || !dev)
+    return true;
+  const char * name = dev->get_dev_name();
+  std::string key = get_type_cache_key(name);
+  if (key.empty())
+    return true;
+  read_type_cache();
+
+  // Use requested type if cached type was used or detected type was
+  // refined by autodetect_open(), e.g. "sat" -> "sat,12"
+  const char * type = dev->get_req_type();
+  if (!*type)
+    type = dev->get_dev_type();
+  bool keep = (dev->is_open() && *type && !strchr(type, '\t'));
+
+  bool changed = false, found = false;
+  for (unsigned i = 0; i < m_type_cache.size(); ) {
+    type_cache_entry & e = m_type_cache[i];
+    if (e.name != name) {
+      i++;
+      continue;
+    }
+    if (keep && !found) {
+      // Update entry
+      if (e.key != key || e.type != type) {
+        e.key = key; e.type = type;
+        changed = true;
+      }
+      found = true;
+      i++;
+    }
+    else {
+      // Remove stale or duplicate entry
+      m_type_cache.erase(m_type_cache.begin() + i);
+      changed = true;
+    }
+  }
+  if (keep && !found) {
+    type_cache_entry e;
+    e.name = name; e.key = key; e.type = type;
+    m_type_cache.push_back(e);
+    changed = true;
+  }
+
+  if (!changed)
+    return true;
+  return write_type_cache();
+}
+
 nvme_device * smart_interface::get_nvme_device(const char * /*name*/, const char * /*type*/, unsigned /*nsid*/)
 {
   set_err(ENOSYS, "NVMe devices are not supported in this version of smartmontools");
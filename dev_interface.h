@@ -226,6 +226,29 @@ public:
   /// Default implementation does nothing.
   virtual void release(const smart_device * dev);
 
+  ///////////////////////////////////////////////
+  // Serialization of controller commands
+
+  /// Lock the controller this device is attached to.
+  /// Must be held while a command sequence is issued through a
+  /// mailbox shared by all devices of the controller.
+  /// Devices on different controllers do not block each other.
+  /// Default implementation does nothing and returns true.
+  virtual bool lock_controller();
+
+  /// Unlock the controller locked by 'lock_controller()'.
+  /// Default implementation does nothing and returns true.
+  virtual bool unlock_controller();
+
+  ///////////////////////////////////////////////
+  // Reusable I/O buffer
+
+  /// Get I/O buffer of at least 'size' bytes, aligned to a page boundary.
+  /// The buffer is owned by this object and reused by later calls,
+  /// its contents are only valid until the next call.
+  /// If 'clear' is set, the first 'size' bytes are set to zero.
+  unsigned char * get_io_buffer(unsigned size, bool clear = true);
+
 protected:
   /// Get interface which produced this object.
   smart_interface * smi()
@@ -240,6 +263,11 @@ private:
   device_info m_info;
   error_info m_err;
 
+  // Buffer for get_io_buffer()
+  unsigned char * m_io_buf_raw;
+  unsigned char * m_io_buf;
+  unsigned m_io_buf_size;
+
   // Pointers for to_ata(), to_scsi(), to_nvme()
   // set by ATA/SCSI/NVMe interface classes.
   friend class ata_device;
@@ -257,6 +285,30 @@ private:
   void operator=(const smart_device &);
 };
 
+/// Holds the controller lock of a device during its lifetime.
+class controller_lock
+{
+public:
+  explicit controller_lock(smart_device * dev)
+    : m_dev(dev), m_locked(dev->lock_controller())
+    { }
+
+  ~controller_lock()
+    { if (m_locked) m_dev->unlock_controller(); }
+
+  /// Return true if the lock was acquired.
+  bool is_locked() const
+    { return m_locked; }
+
+private:
+  smart_device * m_dev;
+  bool m_locked;
+
+  // Prevent copy/assigment
+  controller_lock(const controller_lock &);
+  void operator=(const controller_lock &);
+};
+
 
 /////////////////////////////////////////////////////////////////////////////
 // ATA specific interface
@@ -591,6 +643,16 @@ public:
   /// Returns false on error.
   virtual bool scsi_pass_through(scsi_cmnd_io * iop) = 0;
 
+  /// Get cached response length of LOG SENSE page (subpage 0).
+  /// Returns 0 if unknown, -1 if the length must always be probed.
+  int get_log_page_len(int pagenum) const
+    { return m_log_page_len[pagenum & 0x3f]; }
+
+  /// Set cached response length of LOG SENSE page (subpage 0).
+  /// Use 0 to invalidate, -1 to disable caching for this page.
+  void set_log_page_len(int pagenum, int len)
+    { m_log_page_len[pagenum & 0x3f] = len; }
+
 protected:
   /// Hide/unhide SCSI interface.
   void hide_scsi(bool hide = true)
@@ -599,7 +661,15 @@ protected:
   /// Default constructor, registers device as SCSI.
   scsi_device()
     : smart_device(never_called)
-    { hide_scsi(false); }
+    {
+      hide_scsi(false);
+      for (int i = 0; i < num_log_pages; i++)
+        m_log_page_len[i] = 0;
+    }
+
+private:
+  enum { num_log_pages = 64 };
+  int m_log_page_len[num_log_pages]; ///< Cached LOG SENSE response lengths
 };
 
 
@@ -870,6 +940,7 @@ public:
   static void init();
 
   smart_interface()
+    : m_type_cache_read(false)
     { }
 
   virtual ~smart_interface() throw()
@@ -968,7 +1039,27 @@ public:
   virtual bool scan_smart_devices(smart_device_list & devlist,
     const smart_devtype_list & types, const char * pattern = 0);
 
+  ///////////////////////////////////////////////////////////////////////////
+  // Device type cache:
+
+  /// Set file used to cache results of device type autodetection.
+  /// If set, get_smart_device() with unspecified 'type' reuses the
+  /// cached type if the key of the device (see below) is unchanged.
+  void set_type_cache_file(const char * path)
+    { m_type_cache_file = (path ? path : ""); }
+
+  /// Update type cache after autodetect_open() of device 'dev' which
+  /// was returned by get_smart_device() with unspecified 'type'.
+  /// Entry is saved if device is open, otherwise removed.
+  /// Return false on write error.
+  bool update_type_cache(const smart_device * dev);
+
 protected:
+  /// Return key which identifies device 'name' and its transport path.
+  /// Used to validate type cache entries, must not open the device.
+  /// Default implementation returns empty string (device not cached).
+  virtual std::string get_type_cache_key(const char * name);
+
   /// Return standard ATA device.
   virtual ata_device * get_ata_device(const char * name, const char * type) = 0;
 
@@ -1023,6 +1114,18 @@ protected:
 private:
   smart_device::error_info m_err;
 
+  /// Type cache entry.
+  struct type_cache_entry {
+    std::string name, key, type;
+  };
+  std::string m_type_cache_file; ///< Cache file, empty if disabled.
+  std::vector<type_cache_entry> m_type_cache; ///< Cache entries.
+  bool m_type_cache_read; ///< Cache file already read.
+
+  const char * lookup_type_cache(const char * name);
+  void read_type_cache();
+  bool write_type_cache();
+
   friend smart_interface * smi(); // below
   static smart_interface * s_instance; ///< Pointer to the interface object.
 
@@ -0,0 +1,817 @@
+/*
+ * dev_sim.cpp
+ *
+ * Home page of code is: http://www.smartmontools.org
+ *
+ * Copyright (C) 2026 Smartmontools developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * (for example COPYING); If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+#include "int64.h"
+#include "atacmds.h"
+#include "scsicmds.h"
+#include "utility.h"
+#include "dev_sim.h"
+#include "dev_tunnelled.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h> // Sleep()
+#elif defined(HAVE_UNISTD_H)
+#include <unistd.h> // usleep()
+#endif
+
+#include <string>
+#include <vector>
+
+const char * dev_sim_cpp_cvsid = "$Id$"
+  DEV_SIM_H_CVSID;
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Response file
+
+namespace {
+
+// Response data for one command key
+struct sim_response
+{
+  std::vector<unsigned char> key;
+  std::vector<unsigned char> data;
+};
+
+// Contents of a response file
+struct sim_device_data
+{
+  std::string type; // "ata", "scsi", "nvme"
+  unsigned latency; // usec
+  unsigned failrate; // percent
+  bool smartstatus_failed;
+  unsigned nsid;
+  std::vector<sim_response> responses;
+
+  sim_device_data()
+    : latency(0), failrate(0), smartstatus_failed(false), nsid(0xffffffff)
+    { }
+};
+
+// Read line of any length, return false on EOF
+bool read_line(FILE * f, std::string & line)
+{
+  line.clear();
+  int c;
+  while ((c = getc(f)) != EOF && c != '\n')
+    line += (char)c;
+  return (c != EOF || !line.empty());
+}
+
+// Append hex bytes from STR to DATA, whitespace is ignored.
+// Return false on syntax error.
+bool parse_hex(const char * str, std::vector<unsigned char> & data)
+{
+  int hi = -1;
+  for (const char * p = str; *p; p++) {
+    char c = *p;
+    if (c == ' ' || c == '\t' || c == '\r')
+      continue;
+    int v;
+    if ('0' <= c && c <= '9')
+      v = c - '0';
+    else if ('a' <= c && c <= 'f')
+      v = c - 'a' + 10;
+    else if ('A' <= c && c <= 'F')
+      v = c - 'A' + 10;
+    else
+      return false;
+    if (hi < 0)
+      hi = v;
+    else {
+      data.push_back((unsigned char)((hi << 4) | v));
+      hi = -1;
+    }
+  }
+  return (hi < 0);
+}
+
+// Read response file, return error message or empty string
+std::string read_sim_file(const char * path, sim_device_data & dd)
+{
+  stdio_file f(path, "r");
+  if (!f)
+    return strprintf("%s: %s", path, strerror(errno));
+
+  std::string line;
+  sim_response * resp = 0;
+  for (int lineno = 1; read_line(f, line); lineno++) {
+    size_t i = line.find('#');
+    if (i != std::string::npos)
+      line.erase(i);
+    if (line.find_first_not_of(" \t\r") == std::string::npos)
+      continue;
+
+    // Indented line: Response data
+    if (line[0] == ' ' || line[0] == '\t') {
+      if (!resp || !parse_hex(line.c_str(), resp->data))
+        return strprintf("%s(%d): Invalid response data", path, lineno);
+      continue;
+    }
+
+    char name[16] = ""; int n = -1;
+    sscanf(line.c_str(), "%15s%n", name, &n);
+    const char * arg = line.c_str() + n;
+    resp = 0;
+
+    if (!strcmp(name, "ata") || !strcmp(name, "scsi") || !strcmp(name, "nvme")) {
+      if (dd.type != name)
+        return strprintf("%s(%d): '%s' entry requires 'type %s'", path, lineno, name, name);
+      dd.responses.push_back(sim_response());
+      resp = &dd.responses.back();
+      if (!parse_hex(arg, resp->key) || resp->key.empty())
+        return strprintf("%s(%d): Invalid key", path, lineno);
+      continue;
+    }
+
+    char val[16] = ""; int n2 = -1;
+    sscanf(arg, " %15s%n", val, &n2);
+    if (!(n2 > 0 && line.find_first_not_of(" \t\r", n + n2) == std::string::npos))
+      return strprintf("%s(%d): Syntax error", path, lineno);
+
+    char * end = 0;
+    if (!strcmp(name, "type") && dd.type.empty()
+        && (!strcmp(val, "ata") || !strcmp(val, "scsi") || !strcmp(val, "nvme")))
+      dd.type = val;
+    else if (!strcmp(name, "latency"))
+      dd.latency = strtoul(val, &end, 10);
+    else if (!strcmp(name, "failrate"))
+      dd.failrate = strtoul(val, &end, 10);
+    else if (!strcmp(name, "smartstatus") && !strcmp(val, "failed"))
+      dd.smartstatus_failed = true;
+    else if (!strcmp(name, "nsid"))
+      dd.nsid = strtoul(val, &end, 16);
+    else
+      return strprintf("%s(%d): Syntax error", path, lineno);
+    if (end && (*end || dd.failrate > 100))
+      return strprintf("%s(%d): Invalid value '%s'", path, lineno, val);
+  }
+
+  if (dd.type.empty())
+    return strprintf("%s: Missing 'type' entry", path);
+  return "";
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// sim_device_base
+
+class sim_device_base
+: virtual public /*implements*/ smart_device
+{
+public:
+  virtual bool is_open() const;
+
+  virtual bool open();
+
+  virtual bool close();
+
+protected:
+  explicit sim_device_base(const sim_device_data & dd)
+    : smart_device(never_called),
+      m_dd(dd), m_open(false), m_rand(1)
+    { }
+
+  /// Simulate command latency and failures.
+  /// Return false if command should fail.
+  bool sim_command();
+
+  /// Find response for KEY, return 0 if not found.
+  /// If PREFIX is set, use longest response key which is a prefix of KEY.
+  const sim_response * find_response(const unsigned char * key, unsigned keylen,
+    bool prefix = false) const;
+
+  /// Copy response data at OFFSET to BUF, clear remaining bytes.
+  /// Return number of bytes copied.
+  static unsigned copy_data(const sim_response & resp, uint64_t offset,
+    void * buf, unsigned size);
+
+  const sim_device_data m_dd; ///< Contents of response file
+
+private:
+  bool m_open;
+  unsigned m_rand; ///< State of failure injection generator
+};
+
+bool sim_device_base::is_open() const
+{
+  return m_open;
+}
+
+bool sim_device_base::open()
+{
+  m_open = true;
+  return true;
+}
+
+bool sim_device_base::close()
+{
+  m_open = false;
+  return true;
+}
+
+bool sim_device_base::sim_command()
+{
+  if (!m_open)
+    return set_err(EBADF);
+
+  if (m_dd.latency) {
+#ifdef _WIN32
+    Sleep((m_dd.latency + 999) / 1000);
+#else
+    usleep(m_dd.latency);
+#endif
+  }
+
+  if (m_dd.failrate) {
+    // Reproducible sequence for each device
+    m_rand = m_rand * 1103515245 + 12345;
+    if ((m_rand >> 16) % 100 < m_dd.failrate)
+      return set_err(EIO, "Simulated command failure");
+  }
+  return true;
+}
+
+const sim_response * sim_device_base::find_response(const unsigned char * key,
+  unsigned keylen, bool prefix /* = false */) const
+{
+  const sim_response * found = 0;
+  for (unsigned i = 0; i < m_dd.responses.size(); i++) {
+    const sim_response & resp = m_dd.responses[i];
+    unsigned len = resp.key.size();
+    if (!(prefix ? len <= keylen : len == keylen))
+      continue;
+    if (memcmp(&resp.key[0], key, len))
+      continue;
+    if (!found || found->key.size() < len)
+      found = &resp;
+  }
+  return found;
+}
+
+unsigned sim_device_base::copy_data(const sim_response & resp, uint64_t offset,
+  void * buf, unsigned size)
+{
+  unsigned n = 0;
+  if (offset < resp.data.size()) {
+    n = resp.data.size() - (unsigned)offset;
+    if (n > size)
+      n = size;
+    memcpy(buf, &resp.data[(unsigned)offset], n);
+  }
+  memset((char *)buf + n, 0, size - n);
+  return n;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// sim_ata_device
+
+class sim_ata_device
+: public /*implements*/ ata_device,
+  public /*extends*/ sim_device_base
+{
+public:
+  sim_ata_device(smart_interface * intf, const char * dev_name, const char * req_type,
+    const sim_device_data & dd)
+    : smart_device(intf, dev_name, "sim", req_type),
+      sim_device_base(dd)
+    { }
+
+  virtual bool ata_pass_through(const ata_cmd_in & in, ata_cmd_out & out);
+};
+
+bool sim_ata_device::ata_pass_through(const ata_cmd_in & in, ata_cmd_out & out)
+{
+  if (!ata_cmd_is_supported(in,
+    supports_data_out |
+    supports_output_regs |
+    supports_multi_sector |
+    supports_48bit,
+    "SIM")
+  )
+    return false;
+
+  if (!sim_command())
+    return false;
+
+  const ata_in_regs_48bit & r = in.in_regs;
+  out.out_regs.status = 0x50; // DRDY, DSC
+
+  switch (in.direction) {
+    case ata_cmd_in::no_data:
+      if (r.command == ATA_SMART_CMD && r.features == ATA_SMART_STATUS) {
+        out.out_regs.lba_mid  = (m_dd.smartstatus_failed ? 0xf4 : 0x4f);
+        out.out_regs.lba_high = (m_dd.smartstatus_failed ? 0x2c : 0xc2);
+      }
+      else if (r.command == ATA_CHECK_POWER_MODE)
+        out.out_regs.sector_count = 0xff; // Active or Idle
+      return true;
+
+    case ata_cmd_in::data_out:
+      return true;
+
+    default: {
+      unsigned char key[3] = { r.command, r.features, r.lba_low };
+      const sim_response * resp = find_response(key, sizeof(key));
+      if (!resp) {
+        out.out_regs.status = 0x51; // DRDY, DSC, ERR
+        out.out_regs.error = 0x04; // ABRT
+        return set_err(EIO, "Simulated ATA command 0x%02x/0x%02x/0x%02x not available",
+                       key[0], key[1], key[2]);
+      }
+      // GP logs: Page number in LBA mid (15:0)
+      uint64_t offset = 0;
+      if (r.command == ATA_READ_LOG_EXT || r.command == 0x47 /* READ LOG DMA EXT */)
+        offset = r.lba_mid_16 * 512ULL;
+      copy_data(*resp, offset, in.buffer, in.size);
+      return true;
+    }
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// sim_scsi_device
+
+class sim_scsi_device
+: public /*implements*/ scsi_device,
+  public /*extends*/ sim_device_base
+{
+public:
+  sim_scsi_device(smart_interface * intf, const char * dev_name, const char * req_type,
+    const sim_device_data & dd)
+    : smart_device(intf, dev_name, "sim", req_type),
+      sim_device_base(dd)
+    { }
+
+  virtual bool scsi_pass_through(scsi_cmnd_io * iop);
+};
+
+bool sim_scsi_device::scsi_pass_through(scsi_cmnd_io * iop)
+{
+  if (!sim_command())
+    return false;
+
+  iop->resp_sense_len = 0;
+  iop->scsi_status = 0; // GOOD
+  iop->resid = 0;
+
+  const sim_response * resp = find_response(iop->cmnd, iop->cmnd_len, true);
+  if (iop->dxfer_dir != DXFER_FROM_DEVICE)
+    return true;
+
+  if (!resp) {
+    // ILLEGAL REQUEST, INVALID COMMAND OPERATION CODE
+    unsigned char sense[18] = { 0x70, 0, SCSI_SK_ILLEGAL_REQUEST, 0, 0, 0, 0, 10,
+                                0, 0, 0, 0, SCSI_ASC_UNKNOWN_OPCODE, 0, };
+    unsigned n = (iop->max_sense_len < sizeof(sense) ? iop->max_sense_len : sizeof(sense));
+    if (iop->sensep && n > 0)
+      memcpy(iop->sensep, sense, n);
+    iop->resp_sense_len = n;
+    iop->scsi_status = SCSI_STATUS_CHECK_CONDITION;
+    iop->resid = iop->dxfer_len;
+    return true;
+  }
+
+  unsigned n = copy_data(*resp, 0, iop->dxferp, iop->dxfer_len);
+  iop->resid = iop->dxfer_len - n;
+  return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// sim_nvme_device
+
+class sim_nvme_device
+: public /*implements*/ nvme_device,
+  public /*extends*/ sim_device_base
+{
+public:
+  sim_nvme_device(smart_interface * intf, const char * dev_name, const char * req_type,
+    const sim_device_data & dd)
+    : smart_device(intf, dev_name, "sim", req_type),
+      nvme_device(dd.nsid),
+      sim_device_base(dd)
+    { }
+
+  virtual bool nvme_pass_through(const nvme_cmd_in & in, nvme_cmd_out & out);
+};
+
+bool sim_nvme_device::nvme_pass_through(const nvme_cmd_in & in, nvme_cmd_out & out)
+{
+  if (!sim_command())
+    return false;
+
+  if (in.direction() != nvme_cmd_in::data_in)
+    return true;
+
+  unsigned char key[2] = { in.opcode, (unsigned char)in.cdw10 };
+  const sim_response * resp = find_response(key, sizeof(key));
+  if (!resp)
+    return set_nvme_err(out, 0x0002); // Invalid Field in Command
+
+  // Get Log Page: Offset in LPOL/LPOU
+  uint64_t offset = 0;
+  if (in.opcode == 0x02)
+    offset = in.cdw12 | ((uint64_t)in.cdw13 << 32);
+  copy_data(*resp, offset, in.buffer, in.size);
+  return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// sim_recorder
+
+// Collects the responses of a real device and writes a response file
+class sim_recorder
+{
+public:
+  sim_recorder(const char * path, const char * type, const smart_device * dev)
+    : m_path(path), m_type(type),
+      m_source(strprintf("%s [%s]", dev->get_info_name(), dev->get_dev_type())),
+      m_smartstatus_failed(false), m_nsid(0xffffffff),
+      m_num_commands(0), m_total_usec(0), m_last(-1), m_dirty(false)
+    { }
+
+  ~sim_recorder()
+    {
+      if (m_dirty)
+        write_file();
+    }
+
+  /// Create or truncate the response file, return false on error.
+  bool create_file();
+
+  /// Write the response file if anything has changed.
+  /// Return false on error.
+  bool write_file();
+
+  /// Add response DATA at OFFSET for KEY.
+  void add_response(const unsigned char * key, unsigned keylen,
+    const void * data, unsigned size, uint64_t offset = 0);
+
+  /// Add duration of a command, count it for the last added key.
+  void add_time(int64_t usec);
+
+  void set_smartstatus_failed(bool failed)
+    { m_smartstatus_failed = failed; }
+
+  void set_nsid(unsigned nsid)
+    { m_nsid = nsid; }
+
+private:
+  std::string m_path; ///< Response file
+  std::string m_type; ///< "ata", "scsi", "nvme"
+  std::string m_source; ///< Name of recorded device
+  bool m_smartstatus_failed;
+  unsigned m_nsid;
+
+  // Response data and timing statistics of one key
+  struct entry : public sim_response
+  {
+    unsigned count;
+    int64_t max_usec;
+
+    entry() : count(0), max_usec(0) { }
+  };
+
+  std::vector<entry> m_entries;
+  unsigned m_num_commands;
+  int64_t m_total_usec;
+  int m_last; ///< Index of last added entry or -1
+  bool m_dirty; ///< Set if file needs update
+};
+
+bool sim_recorder::create_file()
+{
+  stdio_file f(m_path.c_str(), "w");
+  return !!f;
+}
+
+bool sim_recorder::write_file()
+{
+  if (!m_dirty)
+    return true;
+  stdio_file f(m_path.c_str(), "w");
+  if (!f)
+    return false;
+  m_dirty = false;
+
+  fprintf(f, "# Recorded from %s\n", m_source.c_str());
+  fprintf(f, "# %u commands, %" PRId64 " usec total\n", m_num_commands, m_total_usec);
+  fprintf(f, "type %s\n", m_type.c_str());
+  if (m_num_commands)
+    fprintf(f, "latency %u\n", (unsigned)(m_total_usec / m_num_commands));
+  if (m_smartstatus_failed)
+    fprintf(f, "smartstatus failed\n");
+  if (m_type == "nvme")
+    fprintf(f, "nsid 0x%x\n", m_nsid);
+
+  for (unsigned i = 0; i < m_entries.size(); i++) {
+    const entry & e = m_entries[i];
+    fprintf(f, "\n# %u commands, max %" PRId64 " usec\n%s", e.count, e.max_usec,
+            m_type.c_str());
+    for (unsigned j = 0; j < e.key.size(); j++)
+      fprintf(f, " %02x", e.key[j]);
+    fprintf(f, "\n");
+    for (unsigned j = 0; j < e.data.size(); j++)
+      fprintf(f, "%s%02x%s", (!(j & 0xf) ? " " : ""), e.data[j],
+              ((j & 0xf) == 0xf || j + 1 == e.data.size() ? "\n" : " "));
+  }
+
+  return !ferror(f);
+}
+
+void sim_recorder::add_response(const unsigned char * key, unsigned keylen,
+  const void * data, unsigned size, uint64_t offset /* = 0 */)
+{
+  m_last = -1;
+  for (unsigned i = 0; i < m_entries.size() && m_last < 0; i++) {
+    const std::vector<unsigned char> & k = m_entries[i].key;
+    if (k.size() == keylen && !memcmp(&k[0], key, keylen))
+      m_last = i;
+  }
+  if (m_last < 0) {
+    m_entries.push_back(entry());
+    m_last = m_entries.size() - 1;
+    m_entries[m_last].key.assign(key, key + keylen);
+  }
+
+  // Merge data at offset, newer data replaces older
+  std::vector<unsigned char> & d = m_entries[m_last].data;
+  if (d.size() < offset + size)
+    d.resize((size_t)(offset + size));
+  if (size)
+    memcpy(&d[(size_t)offset], data, size);
+  m_dirty = true;
+}
+
+void sim_recorder::add_time(int64_t usec)
+{
+  m_num_commands++;
+  m_total_usec += usec;
+  if (m_last >= 0) {
+    entry & e = m_entries[m_last];
+    e.count++;
+    if (e.max_usec < usec)
+      e.max_usec = usec;
+    m_last = -1;
+  }
+  m_dirty = true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// sim_record_ata_device
+
+class sim_record_ata_device
+: public tunnelled_device<
+    /*implements*/ ata_device,
+    /*by tunnelling through a*/ ata_device
+  >
+{
+public:
+  sim_record_ata_device(smart_interface * intf, ata_device * atadev, const char * path)
+    : smart_device(intf, atadev->get_dev_name(), atadev->get_dev_type(),
+                   atadev->get_req_type()),
+      tunnelled_device<ata_device, ata_device>(atadev),
+      m_rec(path, "ata", atadev)
+    { set_info().info_name = atadev->get_info_name(); }
+
+  sim_recorder & get_recorder()
+    { return m_rec; }
+
+  virtual bool close();
+
+  virtual bool ata_pass_through(const ata_cmd_in & in, ata_cmd_out & out);
+
+  virtual bool ata_identify_is_cached() const;
+
+private:
+  sim_recorder m_rec;
+};
+
+bool sim_record_ata_device::close()
+{
+  m_rec.write_file();
+  return tunnelled_device<ata_device, ata_device>::close();
+}
+
+bool sim_record_ata_device::ata_pass_through(const ata_cmd_in & in, ata_cmd_out & out)
+{
+  int64_t start = smi()->get_timer_usec();
+  ata_device * atadev = get_tunnel_dev();
+  if (!atadev->ata_pass_through(in, out))
+    return set_err(atadev->get_err());
+
+  const ata_in_regs_48bit & r = in.in_regs;
+  if (in.direction == ata_cmd_in::data_in) {
+    unsigned char key[3] = { r.command, r.features, r.lba_low };
+    uint64_t offset = 0;
+    if (r.command == ATA_READ_LOG_EXT || r.command == 0x47 /* READ LOG DMA EXT */)
+      offset = r.lba_mid_16 * 512ULL;
+    m_rec.add_response(key, sizeof(key), in.buffer, in.size, offset);
+  }
+  else if (r.command == ATA_SMART_CMD && r.features == ATA_SMART_STATUS
+           && in.out_needed.is_set())
+    m_rec.set_smartstatus_failed(out.out_regs.lba_mid == 0xf4
+                                 && out.out_regs.lba_high == 0x2c);
+  m_rec.add_time(smi()->get_timer_usec() - start);
+  return true;
+}
+
+bool sim_record_ata_device::ata_identify_is_cached() const
+{
+  return get_tunnel_dev()->ata_identify_is_cached();
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// sim_record_scsi_device
+
+class sim_record_scsi_device
+: public tunnelled_device<
+    /*implements*/ scsi_device,
+    /*by tunnelling through a*/ scsi_device
+  >
+{
+public:
+  sim_record_scsi_device(smart_interface * intf, scsi_device * scsidev, const char * path)
+    : smart_device(intf, scsidev->get_dev_name(), scsidev->get_dev_type(),
+                   scsidev->get_req_type()),
+      tunnelled_device<scsi_device, scsi_device>(scsidev),
+      m_rec(path, "scsi", scsidev)
+    { set_info().info_name = scsidev->get_info_name(); }
+
+  sim_recorder & get_recorder()
+    { return m_rec; }
+
+  virtual bool close();
+
+  virtual bool scsi_pass_through(scsi_cmnd_io * iop);
+
+private:
+  sim_recorder m_rec;
+};
+
+bool sim_record_scsi_device::close()
+{
+  m_rec.write_file();
+  return tunnelled_device<scsi_device, scsi_device>::close();
+}
+
+bool sim_record_scsi_device::scsi_pass_through(scsi_cmnd_io * iop)
+{
+  int64_t start = smi()->get_timer_usec();
+  scsi_device * scsidev = get_tunnel_dev();
+  if (!scsidev->scsi_pass_through(iop))
+    return set_err(scsidev->get_err());
+
+  // Record successful DATA IN commands only, others are simulated
+  if (   iop->dxfer_dir == DXFER_FROM_DEVICE && iop->scsi_status == 0
+      && 0 <= iop->resid && iop->resid <= (int)iop->dxfer_len)
+    m_rec.add_response(iop->cmnd, iop->cmnd_len, iop->dxferp,
+                       iop->dxfer_len - iop->resid);
+  m_rec.add_time(smi()->get_timer_usec() - start);
+  return true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// sim_record_nvme_device
+
+// tunnelled_device<> requires a default constructor of the base class,
+// nvme_device requires the namespace id.
+class sim_record_nvme_device
+: public /*implements*/ nvme_device,
+  public /*extends*/ tunnelled_device_base
+{
+public:
+  sim_record_nvme_device(smart_interface * intf, nvme_device * nvmedev, const char * path)
+    : smart_device(intf, nvmedev->get_dev_name(), nvmedev->get_dev_type(),
+                   nvmedev->get_req_type()),
+      nvme_device(nvmedev->get_nsid()),
+      tunnelled_device_base(nvmedev),
+      m_nvmedev(nvmedev),
+      m_rec(path, "nvme", nvmedev)
+    {
+      set_info().info_name = nvmedev->get_info_name();
+      m_rec.set_nsid(nvmedev->get_nsid());
+    }
+
+  sim_recorder & get_recorder()
+    { return m_rec; }
+
+  virtual bool close();
+
+  virtual void release(const smart_device * dev);
+
+  virtual bool nvme_pass_through(const nvme_cmd_in & in, nvme_cmd_out & out);
+
+private:
+  nvme_device * m_nvmedev;
+  sim_recorder m_rec;
+};
+
+bool sim_record_nvme_device::close()
+{
+  m_rec.write_file();
+  return tunnelled_device_base::close();
+}
+
+void sim_record_nvme_device::release(const smart_device * dev)
+{
+  if (m_nvmedev == dev)
+    m_nvmedev = 0;
+  tunnelled_device_base::release(dev);
+}
+
+bool sim_record_nvme_device::nvme_pass_through(const nvme_cmd_in & in, nvme_cmd_out & out)
+{
+  int64_t start = smi()->get_timer_usec();
+  if (!m_nvmedev->nvme_pass_through(in, out))
+    return set_err(m_nvmedev->get_err());
+
+  if (in.direction() == nvme_cmd_in::data_in) {
+    unsigned char key[2] = { in.opcode, (unsigned char)in.cdw10 };
+    uint64_t offset = 0;
+    if (in.opcode == 0x02) // Get Log Page
+      offset = in.cdw12 | ((uint64_t)in.cdw13 << 32);
+    m_rec.add_response(key, sizeof(key), in.buffer, in.size, offset);
+  }
+  m_rec.add_time(smi()->get_timer_usec() - start);
+  return true;
+}
+
+} // namespace
+
+
+smart_device * get_sim_device(smart_interface * intf, const char * name,
+  const char * type)
+{
+  sim_device_data dd;
+  std::string msg = read_sim_file(name, dd);
+  if (!msg.empty()) {
+    intf->set_err(EINVAL, "%s", msg.c_str());
+    return 0;
+  }
+
+  if (dd.type == "ata")
+    return new sim_ata_device(intf, name, type, dd);
+  if (dd.type == "scsi")
+    return new sim_scsi_device(intf, name, type, dd);
+  return new sim_nvme_device(intf, name, type, dd);
+}
+
+smart_device * get_sim_recorder(smart_interface * intf, smart_device * dev,
+  const char * path)
+{
+  sim_recorder * rec;
+  smart_device * recdev;
+  if (dev->is_ata()) {
+    sim_record_ata_device * d = new sim_record_ata_device(intf, dev->to_ata(), path);
+    rec = &d->get_recorder(); recdev = d;
+  }
+  else if (dev->is_scsi()) {
+    sim_record_scsi_device * d = new sim_record_scsi_device(intf, dev->to_scsi(), path);
+    rec = &d->get_recorder(); recdev = d;
+  }
+  else if (dev->is_nvme()) {
+    sim_record_nvme_device * d = new sim_record_nvme_device(intf, dev->to_nvme(), path);
+    rec = &d->get_recorder(); recdev = d;
+  }
+  else {
+    intf->set_err(ENOSYS, "%s: Recording not supported for this device type",
+                  dev->get_info_name());
+    return 0;
+  }
+
+  if (!rec->create_file()) {
+    intf->set_err(errno, "%s: %s", path, strerror(errno));
+    recdev->release(dev);
+    delete recdev;
+    return 0;
+  }
+  return recdev;
+}
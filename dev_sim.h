@@ -0,0 +1,71 @@
+/*
+ * dev_sim.h
+ *
+ * Home page of code is: http://www.smartmontools.org
+ *
+ * Copyright (C) 2026 Smartmontools developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * (for example COPYING); If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DEV_SIM_H
+#define DEV_SIM_H
+
+#define DEV_SIM_H_CVSID "$Id$"
+
+#include "dev_interface.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Simulated devices
+//
+// Device type 'sim' serves ATA, SCSI or NVMe commands from a response
+// file instead of real hardware.  The device name is the path of the
+// response file.  This allows testing and profiling of smartctl and
+// smartd without the actual devices.
+//
+// Response file format:
+//
+//   # Comment
+//   type ata|scsi|nvme    Device protocol, required
+//   latency USEC          Delay of each command in microseconds
+//   failrate PERCENT      Percentage of commands failing with EIO
+//   smartstatus failed    ATA SMART RETURN STATUS reports failure
+//   nsid 0xN              NVMe namespace id, default 0xffffffff
+//
+//   ata CMD FEATURES LBA_LOW
+//   scsi CDB_PREFIX...
+//   nvme OPCODE CDW10[7:0]
+//     HEX DATA...
+//
+// A key line ('ata', 'scsi', 'nvme') is followed by indented lines
+// with the response data as hex bytes.  Key bytes are hex too.
+// SCSI keys match the longest prefix of the CDB, allocation lengths
+// are honored by truncating the data.  Offsets of READ LOG EXT and of
+// NVMe Get Log Page (LPOL/LPOU) select the data at this offset.
+// Non-data commands without a response entry succeed, ATA CHECK POWER
+// MODE reports active.  Data-in commands without a response entry fail.
+//
+// A response file could also be recorded from a real device, see
+// get_sim_recorder() below.
+
+/// Create simulated device for type TYPE ("sim").  NAME is the path
+/// of the response file.  Returns 0 on error, error info of INTF is set.
+smart_device * get_sim_device(smart_interface * intf, const char * name,
+  const char * type);
+
+/// Create device which passes all commands to the open device DEV and
+/// records the responses and command durations in response file PATH.
+/// The file is written on each close() and on destruction.  The new
+/// device owns DEV.  Returns 0 on error, error info of INTF is set and
+/// ownership of DEV is not changed.
+smart_device * get_sim_recorder(smart_interface * intf, smart_device * dev,
+  const char * path);
+
+#endif // DEV_SIM_H
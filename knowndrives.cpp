@@ -18,6 +18,7 @@
 
 #include "config.h"
 #include "int64.h"
+#include <ctype.h>
 #include <stdio.h>
 #include "atacmds.h"
 #include "knowndrives.h"
@@ -30,6 +31,8 @@
 #include <io.h> // access()
 #endif
 
+#include <algorithm>
+#include <map>
 #include <stdexcept>
 
 const char * knowndrives_cpp_cvsid = "$Id$"
@@ -175,15 +178,69 @@ static bool compile(regular_expression & regex, const char *pattern)
   return true;
 }
 
+// Check whether the literal prefix of a regular expression could
+// match the beginning of str.  This allows most database entries to
+// be skipped without compiling the regular expression.
+// Returns false only if a full match is impossible.
+static bool literal_prefix_match(const char * pattern, const char * str)
+{
+  // Any top-level '|' allows alternatives with other prefixes
+  int level = 0;
+  for (const char * p = pattern; *p; p++) {
+    switch (*p) {
+      case '\\': if (p[1]) p++; break;
+      case '(': level++; break;
+      case ')': level--; break;
+      case '[':
+        // Skip bracket expression, ']' is literal if first
+        if (p[1] == '^') p++;
+        if (p[1] == ']') p++;
+        while (p[1] && p[1] != ']') {
+          p++;
+          if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+            // Skip "[:class:]", "[.coll.]", "[=equiv=]"
+            char d = p[1];
+            const char * e = strchr(p + 2, d);
+            while (e && e[1] != ']')
+              e = strchr(e + 1, d);
+            if (!e)
+              break;
+            p = e + 1;
+          }
+        }
+        break;
+      case '|': if (level <= 0) return true; break;
+    }
+  }
+
+  int i;
+  for (i = 0; pattern[i]; i++) {
+    char c = pattern[i];
+    if (!(('0' <= c && c <= '9') || ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z')
+          || c == ' ' || c == '-' || c == '_' || c == ':'))
+      break;
+  }
+  // Last literal is optional if followed by a quantifier
+  if (i > 0 && (pattern[i] == '*' || pattern[i] == '?' || pattern[i] == '{'))
+    i--;
+
+  return !strncmp(pattern, str, i);
+}
+
 // Compile & match a regular expression.
 static bool match(const char * pattern, const char * str)
 {
+  if (!literal_prefix_match(pattern, str))
+    return false;
   regular_expression regex;
   if (!compile(regex, pattern))
     return false;
   return regex.full_match(str);
 }
 
+// Deferred init_drive_database(), see below.
+static void load_drive_database();
+
 // Searches knowndrives[] for a drive with the given model number and firmware
 // string.  If either the drive's model or firmware strings are not set by the
 // manufacturer then values of NULL may be used.  Returns the entry of the
@@ -288,10 +345,138 @@ static void parse_usb_names(const char * names, usb_dev_info & info)
     info.usb_bridge = names+n3;
 }
 
+// Expand a regular expression without repetitions into the list of
+// all strings it matches.  Supports literals, bracket expressions
+// and nested '(...|...)' groups.  Returns false if the pattern
+// contains other constructs or more than max strings would result.
+static bool expand_alternatives(const char * & p, std::vector<std::string> & result,
+                                unsigned max)
+{
+  result.clear();
+  for (;;) {
+    std::vector<std::string> seq(1);
+    while (*p && *p != '|' && *p != ')') {
+      std::vector<std::string> item;
+      if (*p == '(') {
+        p++;
+        if (!expand_alternatives(p, item, max) || *p != ')')
+          return false;
+        p++;
+      }
+      else if (*p == '[') {
+        p++;
+        if (*p == '^' || *p == ']')
+          return false;
+        while (*p && *p != ']') {
+          if (*p == '[' || *p == '\\')
+            return false;
+          if (p[1] == '-' && p[2] && p[2] != ']') {
+            for (int c = (unsigned char)p[0]; c <= (unsigned char)p[2]; c++)
+              item.push_back(std::string(1, (char)c));
+            p += 3;
+          }
+          else
+            item.push_back(std::string(1, *p++));
+        }
+        if (!*p)
+          return false;
+        p++;
+      }
+      else if (isalnum((unsigned char)*p) || *p == ':')
+        item.push_back(std::string(1, *p++));
+      else
+        return false;
+
+      if (*p == '*' || *p == '+' || *p == '?' || *p == '{')
+        return false;
+      if (seq.size() * item.size() > max)
+        return false;
+
+      std::vector<std::string> next;
+      next.reserve(seq.size() * item.size());
+      for (unsigned i = 0; i < seq.size(); i++)
+        for (unsigned j = 0; j < item.size(); j++)
+          next.push_back(seq[i] + item[j]);
+      seq.swap(next);
+    }
+
+    if (result.size() + seq.size() > max)
+      return false;
+    result.insert(result.end(), seq.begin(), seq.end());
+    if (*p != '|')
+      return true;
+    p++;
+  }
+}
+
+// Parse "0xVVVV:0xPPPP" as formatted by lookup_usb_device().
+static bool parse_usb_id(const std::string & s, unsigned & id)
+{
+  if (!(   s.size() == 13 && s[0] == '0' && s[1] == 'x' && s[6] == ':'
+        && s[7] == '0' && s[8] == 'x'))
+    return false;
+  id = 0;
+  for (int i = 2; i < 13; i++) {
+    if (i == 6)
+      i = 9;
+    char c = s[i];
+    if ('0' <= c && c <= '9')
+      id = (id << 4) | (c - '0');
+    else if ('a' <= c && c <= 'f')
+      id = (id << 4) | (c - 'a' + 10);
+    else
+      return false;
+  }
+  return true;
+}
+
+// Index of USB entries in knowndrives[]: Entry numbers by vendor:product
+// ID, and entries with ID patterns which could not be expanded.
+static std::map<unsigned, std::vector<unsigned> > usb_id_index;
+static std::vector<unsigned> usb_id_other;
+static unsigned usb_id_index_size = 0;
+
+// (Re)build USB ID index if the database has changed.
+static void update_usb_id_index()
+{
+  if (usb_id_index_size == knowndrives.size())
+    return;
+  usb_id_index.clear();
+  usb_id_other.clear();
+
+  std::vector<std::string> ids;
+  for (unsigned i = 0; i < knowndrives.size(); i++) {
+    const drive_settings & dbentry = knowndrives[i];
+    if (get_dbentry_type(&dbentry) != DBENTRY_USB)
+      continue;
+
+    const char * p = dbentry.modelregexp;
+    if (!(expand_alternatives(p, ids, 256) && !*p)) {
+      usb_id_other.push_back(i);
+      continue;
+    }
+
+    // Strings not in USB ID format never match
+    for (unsigned j = 0; j < ids.size(); j++) {
+      unsigned id;
+      if (!parse_usb_id(ids[j], id))
+        continue;
+      std::vector<unsigned> & bucket = usb_id_index[id];
+      if (bucket.empty() || bucket.back() != i)
+        bucket.push_back(i);
+    }
+  }
+
+  usb_id_index_size = knowndrives.size();
+}
+
 // Search drivedb for USB device with vendor:product ID.
 int lookup_usb_device(int vendor_id, int product_id, int bcd_device,
                       usb_dev_info & info, usb_dev_info & info2)
 {
+  load_drive_database();
+  update_usb_id_index();
+
   // Format strings to match
   char usb_id_str[16], bcd_dev_str[16];
   snprintf(usb_id_str, sizeof(usb_id_str), "0x%04x:0x%04x", vendor_id, product_id);
@@ -300,17 +485,25 @@ int lookup_usb_device(int vendor_id, int product_id, int bcd_device,
   else
     bcd_dev_str[0] = 0;
 
-  int found = 0;
-  for (unsigned i = 0; i < knowndrives.size(); i++) {
-    const drive_settings & dbentry = knowndrives[i];
-
-    // Skip drive entries
-    if (get_dbentry_type(&dbentry) != DBENTRY_USB)
-      continue;
+  // Get entries with matching USB vendor:product ID in database order
+  std::vector<unsigned> entries;
+  if (0 <= vendor_id && vendor_id <= 0xffff && 0 <= product_id && product_id <= 0xffff) {
+    std::map<unsigned, std::vector<unsigned> >::const_iterator it =
+      usb_id_index.find(((unsigned)vendor_id << 16) | (unsigned)product_id);
+    if (it != usb_id_index.end())
+      entries = it->second;
+  }
+  if (!usb_id_other.empty()) {
+    for (unsigned j = 0; j < usb_id_other.size(); j++) {
+      if (match(knowndrives[usb_id_other[j]].modelregexp, usb_id_str))
+        entries.push_back(usb_id_other[j]);
+    }
+    std::sort(entries.begin(), entries.end());
+  }
 
-    // Check whether USB vendor:product ID matches
-    if (!match(dbentry.modelregexp, usb_id_str))
-      continue;
+  int found = 0;
+  for (unsigned k = 0; k < entries.size(); k++) {
+    const drive_settings & dbentry = knowndrives[entries[k]];
 
     // Parse '-d type'
     usb_dev_info d;
@@ -469,6 +662,8 @@ static int showonepreset(const drive_settings * dbentry)
 // Returns #syntax errors.
 int showallpresets()
 {
+  load_drive_database();
+
   // loop over all entries in the knowndrives[] table, printing them
   // out in a nice format
   int errcnt = 0;
@@ -494,6 +689,8 @@ int showallpresets()
 // Returns # matching entries.
 int showmatchingpresets(const char *model, const char *firmware)
 {
+  load_drive_database();
+
   int cnt = 0;
   const char * firmwaremsg = (firmware ? firmware : "(any)");
 
@@ -527,6 +724,8 @@ int showmatchingpresets(const char *model, const char *firmware)
 // Shows the presets (if any) that are available for the given drive.
 void show_presets(const ata_identify_device * drive)
 {
+  load_drive_database();
+
   char model[MODEL_STRING_LENGTH+1], firmware[FIRMWARE_STRING_LENGTH+1];
 
   // get the drive's model/firmware strings
@@ -563,6 +762,8 @@ const drive_settings * lookup_drive_apply_presets(
   const ata_identify_device * drive, ata_vendor_attr_defs & defs,
   firmwarebug_defs & firmwarebugs)
 {
+  load_drive_database();
+
   // get the drive's model/firmware strings
   char model[MODEL_STRING_LENGTH+1], firmware[FIRMWARE_STRING_LENGTH+1];
   ata_format_id_string(model, drive->model, sizeof(model)-1);
@@ -967,8 +1168,32 @@ bool init_drive_database(bool use_default_db)
   return init_default_attr_defs();
 }
 
+// Parameters of deferred init_drive_database().
+static bool lazy_init_pending = false;
+static bool lazy_use_default_db = false;
+static int lazy_fail_status = 0;
+
+// Defer init_drive_database() until the database is first used.
+void init_drive_database_lazy(bool use_default_db, int fail_status)
+{
+  lazy_init_pending = true;
+  lazy_use_default_db = use_default_db;
+  lazy_fail_status = fail_status;
+}
+
+// Run deferred init_drive_database() if still pending.
+static void load_drive_database()
+{
+  if (!lazy_init_pending)
+    return;
+  lazy_init_pending = false;
+  if (!init_drive_database(lazy_use_default_db))
+    EXIT(lazy_fail_status);
+}
+
 // Get vendor attribute options from default db entry.
 const ata_vendor_attr_defs & get_default_attr_defs()
 {
+  load_drive_database();
   return default_attr_defs;
 }
@@ -75,6 +75,10 @@ bool read_drive_database(const char * path);
 // Init default db entry and optionally read drive databases from standard places.
 bool init_drive_database(bool use_default_db);
 
+// Defer init_drive_database() until the database is first used.
+// EXIT(fail_status) is called if the deferred init fails.
+void init_drive_database_lazy(bool use_default_db, int fail_status);
+
 // Get vendor attribute options from default db entry.
 const ata_vendor_attr_defs & get_default_attr_defs();
 
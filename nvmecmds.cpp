@@ -196,20 +196,45 @@ bool nvme_read_id_ns(nvme_device * device, unsigned nsid, nvme_id_ns & id_ns)
 }
 
 // Read NVMe log page with identifier LID.
-bool nvme_read_log_page(nvme_device * device, unsigned char lid, void * data, unsigned size)
+bool nvme_read_log_page(nvme_device * device, unsigned char lid, void * data, unsigned size,
+  uint64_t offset /* = 0 */, unsigned char lsp /* = 0 */)
 {
-  if (!(4 <= size && size <= 0x4000 && (size % 4) == 0))
+  if (!(4 <= size && size <= nvme_log_chunk_size && (size % 4) == 0))
     throw std::logic_error("nvme_read_log_page(): invalid size");
+  if ((offset % 4) != 0 || lsp > 0x0f)
+    throw std::logic_error("nvme_read_log_page(): invalid offset or lsp");
 
   memset(data, 0, size);
   nvme_cmd_in in;
   in.set_data_in(nvme_admin_get_log_page, data, size);
   in.nsid = device->get_nsid();
-  in.cdw10 = lid | (((size / 4) - 1) << 16);
+  in.cdw10 = lid | (lsp << 8) | (((size / 4) - 1) << 16);
+  in.cdw12 = (unsigned)offset; // LPOL
+  in.cdw13 = (unsigned)(offset >> 32); // LPOU
 
   return nvme_pass_through(device, in);
 }
 
+// Read NVMe log page in chunks.
+bool nvme_read_log_page_chunked(nvme_device * device, unsigned char lid, uint64_t size,
+  nvme_log_sink & sink)
+{
+  // Buffer is reused for all chunks
+  unsigned char * buf = device->get_io_buffer(nvme_log_chunk_size, false);
+
+  for (uint64_t offset = 0; offset < size; ) {
+    unsigned chunk = (size - offset < nvme_log_chunk_size ?
+                      (unsigned)(size - offset) : nvme_log_chunk_size);
+    // Align transfer size to dword boundary
+    if (!nvme_read_log_page(device, lid, buf, ((chunk + 4-1) / 4) * 4, offset))
+      return false;
+    if (!sink.put_data(buf, chunk, offset))
+      break;
+    offset += chunk;
+  }
+  return true;
+}
+
 // Read NVMe Error Information Log.
 bool nvme_read_error_log(nvme_device * device, nvme_error_log_page * error_log, unsigned num_entries)
 {
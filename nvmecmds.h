@@ -227,7 +227,30 @@ bool nvme_read_id_ctrl(nvme_device * device, smartmontools::nvme_id_ctrl & id_ct
 bool nvme_read_id_ns(nvme_device * device, unsigned nsid, smartmontools::nvme_id_ns & id_ns);
 
 // Read NVMe log page with identifier LID.
-bool nvme_read_log_page(nvme_device * device, unsigned char lid, void * data, unsigned size);
+// A nonzero OFFSET requires support of extended data (LPA bit 2).
+// LSP is the log specific field (CDW10 11:08).
+bool nvme_read_log_page(nvme_device * device, unsigned char lid, void * data, unsigned size,
+  uint64_t offset = 0, unsigned char lsp = 0);
+
+// Receives data from nvme_read_log_page_chunked().
+class nvme_log_sink
+{
+public:
+  virtual ~nvme_log_sink() { }
+
+  // Called for each chunk in ascending OFFSET order.
+  // DATA is only valid during the call.  Return false to stop reading.
+  virtual bool put_data(const unsigned char * data, unsigned size, uint64_t offset) = 0;
+};
+
+// Maximum size of a single Get Log Page transfer.
+const unsigned nvme_log_chunk_size = 0x4000;
+
+// Read SIZE bytes of NVMe log page LID in offset addressed chunks
+// and pass each chunk to SINK.  Memory use does not depend on SIZE.
+// SIZE above 'nvme_log_chunk_size' requires support of extended data.
+bool nvme_read_log_page_chunked(nvme_device * device, unsigned char lid, uint64_t size,
+  nvme_log_sink & sink);
 
 // Read NVMe Error Information Log.
 bool nvme_read_error_log(nvme_device * device, smartmontools::nvme_error_log_page * error_log,
@@ -360,11 +360,52 @@ static void print_error_log(const nvme_error_log_page * error_log,
   pout("\n");
 }
 
+// Hex dump of log page chunks in dStrHex() format, addresses continue
+// over chunks.
+class nvme_log_hexdump
+: public nvme_log_sink
+{
+public:
+  virtual bool put_data(const unsigned char * data, unsigned size, uint64_t offset);
+};
+
+bool nvme_log_hexdump::put_data(const unsigned char * data, unsigned size, uint64_t offset)
+{
+  dStrHexAddr(data, (int)size, 0, offset);
+  return true;
+}
+
+// Dump Telemetry Host-Initiated log up to the last block of data area AREA.
+static bool print_telemetry_log(nvme_device * device, unsigned char area)
+{
+  // Read header, this also creates a new snapshot of the telemetry data
+  unsigned char hdr[512];
+  if (!nvme_read_log_page(device, 0x07, hdr, sizeof(hdr), 0, 0x1)) {
+    pout("Read NVMe Telemetry Host-Initiated Log failed: %s\n\n", device->get_errmsg());
+    return false;
+  }
+
+  // Last block of data areas 1, 2, 3 at offsets 8, 10, 12
+  unsigned last_block = hdr[8 + 2*(area-1)] | (hdr[8 + 2*(area-1) + 1] << 8);
+  uint64_t size = (last_block + 1) * 512ULL;
+  pout("NVMe Telemetry Host-Initiated Log, Data Area %d (0x%" PRIx64 " bytes)\n",
+       area, size);
+
+  nvme_log_hexdump dump;
+  if (!nvme_read_log_page_chunked(device, 0x07, size, dump)) {
+    pout("Read NVMe Telemetry Host-Initiated Log failed: %s\n\n", device->get_errmsg());
+    return false;
+  }
+  pout("\n");
+  return true;
+}
+
 int nvmePrintMain(nvme_device * device, const nvme_print_options & options)
 {
   if (!(   options.drive_info || options.drive_capabilities
         || options.smart_check_status || options.smart_vendor_attrib
-        || options.error_log_entries || options.log_page_size       )) {
+        || options.error_log_entries || options.log_page_size
+        || options.telemetry_area                                  )) {
     pout("NVMe device successfully opened\n\n"
          "Use 'smartctl -a' (or '-x') to print SMART (and more) information\n\n");
     return 0;
@@ -437,9 +478,8 @@ int nvmePrintMain(nvme_device * device, const nvme_print_options & options)
   // Print Error Information Log
   if (options.error_log_entries) {
     unsigned num_entries = id_ctrl.elpe + 1; // 0-based value
-    raw_buffer error_log_buf(num_entries * sizeof(nvme_error_log_page));
-    nvme_error_log_page * error_log =
-      reinterpret_cast<nvme_error_log_page *>(error_log_buf.data());
+    nvme_error_log_page * error_log = reinterpret_cast<nvme_error_log_page *>(
+      device->get_io_buffer(num_entries * sizeof(nvme_error_log_page)));
 
     if (!nvme_read_error_log(device, error_log, num_entries)) {
       pout("Read Error Information Log failed: %s\n\n", device->get_errmsg());
@@ -453,17 +493,31 @@ int nvmePrintMain(nvme_device * device, const nvme_print_options & options)
   if (options.log_page_size) {
     // Align size to dword boundary
     unsigned size = ((options.log_page_size + 4-1) / 4) * 4;
-    raw_buffer log_buf(size);
 
-    if (!nvme_read_log_page(device, options.log_page, log_buf.data(), size)) {
-      pout("Read NVMe Log 0x%02x failed: %s\n\n", options.log_page, device->get_errmsg());
+    if (size > nvme_log_chunk_size && !(id_ctrl.lpa & 0x04)) {
+      pout("Read NVMe Log 0x%02x failed: Log page offset not supported, max size is 0x%04x\n\n",
+           options.log_page, nvme_log_chunk_size);
       return retval | FAILSMART;
     }
 
     pout("NVMe Log 0x%02x (0x%04x bytes)\n", options.log_page, size);
-    dStrHex(log_buf.data(), size, 0);
+    nvme_log_hexdump dump;
+    if (!nvme_read_log_page_chunked(device, options.log_page, size, dump)) {
+      pout("Read NVMe Log 0x%02x failed: %s\n\n", options.log_page, device->get_errmsg());
+      return retval | FAILSMART;
+    }
     pout("\n");
   }
 
+  // Dump Telemetry log
+  if (options.telemetry_area) {
+    if ((id_ctrl.lpa & 0x0c) != 0x0c) {
+      pout("NVMe Telemetry Log not supported\n\n");
+      return retval | FAILSMART;
+    }
+    if (!print_telemetry_log(device, options.telemetry_area))
+      return retval | FAILSMART;
+  }
+
   return retval;
 }
@@ -32,6 +32,7 @@ struct nvme_print_options
   unsigned error_log_entries;
   unsigned char log_page;
   unsigned log_page_size;
+  unsigned char telemetry_area;
 
   nvme_print_options()
     : drive_info(false),
@@ -40,7 +41,8 @@ struct nvme_print_options
       smart_vendor_attrib(false),
       error_log_entries(0),
       log_page(0),
-      log_page_size(0)
+      log_page_size(0),
+      telemetry_area(0)
     { }
 };
 
@@ -29,6 +29,7 @@
 #else
 #include <sys/ata.h>
 #endif
+#include <sys/file.h> // flock()
 #include <sys/stat.h>
 #include <unistd.h>
 #include <glob.h>
@@ -1276,15 +1277,33 @@ int freebsd_areca_ata_device::arcmsr_do_scsi_io(struct scsi_cmnd_io * iop)
   return ioctlreturn;
 }
 
-bool freebsd_areca_ata_device::arcmsr_lock()
+// All disks share the message buffer of the controller, serialize
+// with other processes accessing the same /dev/arcmsrN.
+// 'op' is LOCK_EX or LOCK_UN.
+static bool areca_flock(smart_device * dev, int fd, int op)
 {
+  if (flock(fd, op) < 0) {
+    if (op == LOCK_UN)
+      return dev->set_err(errno);
+    return dev->set_err(errno, "cannot lock %s", dev->get_dev_name());
+  }
   return true;
 }
 
 
+bool freebsd_areca_ata_device::arcmsr_lock()
+{
+  if (!is_open() && !open())
+    return false;
+  return areca_flock(this, get_fd(), LOCK_EX);
+}
+
+
 bool freebsd_areca_ata_device::arcmsr_unlock()
 {
-  return true;
+  if (!is_open())
+    return true;
+  return areca_flock(this, get_fd(), LOCK_UN);
 }
 
 
@@ -1323,13 +1342,17 @@ int freebsd_areca_scsi_device::arcmsr_do_scsi_io(struct scsi_cmnd_io * iop)
 
 bool freebsd_areca_scsi_device::arcmsr_lock()
 {
-  return true;
+  if (!is_open() && !open())
+    return false;
+  return areca_flock(this, get_fd(), LOCK_EX);
 }
 
 
 bool freebsd_areca_scsi_device::arcmsr_unlock()
 {
-  return true;
+  if (!is_open())
+    return true;
+  return areca_flock(this, get_fd(), LOCK_UN);
 }
 
 
@@ -65,6 +65,7 @@
 #include <scsi/sg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h> // flock()
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/utsname.h>
@@ -1106,6 +1107,33 @@ bool linux_aacraid_device::scsi_pass_through(scsi_cmnd_io *iop)
 /////////////////////////////////////////////////////////////////////////////
 /// LSI MegaRAID support
 
+// The ioctl node addresses all MegaRAID hosts through
+// megasas_iocpacket::host_no, so a single handle is shared by all
+// devices and DCMD requests.  It is closed with its last user.
+static int megasas_node_fd = -1;
+static unsigned megasas_node_refs = 0;
+
+static int megasas_node_open()
+{
+  if (megasas_node_fd < 0) {
+    megasas_node_fd = ::open("/dev/megaraid_sas_ioctl_node", O_RDWR);
+    if (megasas_node_fd < 0)
+      return -1;
+  }
+  megasas_node_refs++;
+  return megasas_node_fd;
+}
+
+static void megasas_node_close()
+{
+  if (!megasas_node_refs)
+    return;
+  if (!--megasas_node_refs) {
+    ::close(megasas_node_fd);
+    megasas_node_fd = -1;
+  }
+}
+
 class linux_megaraid_device
 : public /* implements */ scsi_device,
   public /* extends */ linux_smart_device
@@ -1127,6 +1155,7 @@ private:
   unsigned int m_disknum;
   unsigned int m_hba;
   int m_fd;
+  struct megasas_iocpacket m_uio; ///< Frame reused by megasas_cmd()
 
   bool (linux_megaraid_device::*pt_cmd)(int cdblen, void *cdb, int dataLen, void *data,
     int senseLen, void *sense, int report, int direction);
@@ -1149,8 +1178,8 @@ linux_megaraid_device::linux_megaraid_device(smart_interface *intf,
 
 linux_megaraid_device::~linux_megaraid_device() throw()
 {
-  if (m_fd >= 0)
-    ::close(m_fd);
+  // Also resets the handle of the base class which may be shared
+  close();
 }
 
 smart_device * linux_megaraid_device::autodetect_open()
@@ -1215,6 +1244,14 @@ bool linux_megaraid_device::open()
     } // we dont need this device anymore
     linux_smart_device::close();
   }
+
+  /* Reuse the ioctl node if already opened by another device */
+  if (megasas_node_fd >= 0 && (m_fd = megasas_node_open()) >= 0) {
+    pt_cmd = &linux_megaraid_device::megasas_cmd;
+    set_fd(m_fd);
+    return true;
+  }
+
   /* Perform mknod of device ioctl node */
   FILE * fp = fopen("/proc/devices", "r");
   while (fgets(line, sizeof(line), fp) != NULL) {
@@ -1237,7 +1274,7 @@ bool linux_megaraid_device::open()
   fclose(fp);
 
   /* Open Device IOCTL node */
-  if ((m_fd = ::open("/dev/megaraid_sas_ioctl_node", O_RDWR)) >= 0) {
+  if ((m_fd = megasas_node_open()) >= 0) {
     pt_cmd = &linux_megaraid_device::megasas_cmd;
   }
   else if ((m_fd = ::open("/dev/megadev0", O_RDWR)) >= 0) {
@@ -1254,7 +1291,9 @@ bool linux_megaraid_device::open()
 
 bool linux_megaraid_device::close()
 {
-  if (m_fd >= 0)
+  if (pt_cmd == &linux_megaraid_device::megasas_cmd)
+    megasas_node_close();
+  else if (m_fd >= 0)
     ::close(m_fd);
   m_fd = -1; m_hba = 0; pt_cmd = 0;
   set_fd(m_fd);
@@ -1322,7 +1361,7 @@ bool linux_megaraid_device::megasas_cmd(int cdbLen, void *cdb,
   int /*senseLen*/, void * /*sense*/, int /*report*/, int dxfer_dir)
 {
   struct megasas_pthru_frame	*pthru;
-  struct megasas_iocpacket	uio;
+  struct megasas_iocpacket	&uio = m_uio;
 
   memset(&uio, 0, sizeof(uio));
   pthru = &uio.frame.pthru;
@@ -2030,14 +2069,31 @@ int linux_areca_ata_device::arcmsr_do_scsi_io(struct scsi_cmnd_io * iop)
   return ioctlreturn;
 }
 
-bool linux_areca_ata_device::arcmsr_lock()
+// All disks share the message buffer of the controller, serialize
+// with other processes accessing the same /dev/sgN.
+// 'op' is LOCK_EX or LOCK_UN.
+static bool areca_flock(smart_device * dev, int fd, int op)
 {
+  if (flock(fd, op) < 0) {
+    if (op == LOCK_UN)
+      return dev->set_err(errno);
+    return dev->set_err(errno, "cannot lock %s", dev->get_dev_name());
+  }
   return true;
 }
 
+bool linux_areca_ata_device::arcmsr_lock()
+{
+  if (!is_open() && !open())
+    return false;
+  return areca_flock(this, get_fd(), LOCK_EX);
+}
+
 bool linux_areca_ata_device::arcmsr_unlock()
 {
-  return true;
+  if (!is_open())
+    return true;
+  return areca_flock(this, get_fd(), LOCK_UN);
 }
 
 // Areca RAID Controller(SAS Device)
@@ -2077,12 +2133,16 @@ int linux_areca_scsi_device::arcmsr_do_scsi_io(struct scsi_cmnd_io * iop)
 
 bool linux_areca_scsi_device::arcmsr_lock()
 {
-  return true;
+  if (!is_open() && !open())
+    return false;
+  return areca_flock(this, get_fd(), LOCK_EX);
 }
 
 bool linux_areca_scsi_device::arcmsr_unlock()
 {
-  return true;
+  if (!is_open())
+    return true;
+  return areca_flock(this, get_fd(), LOCK_UN);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -2730,6 +2790,8 @@ protected:
 
   virtual std::string get_valid_custom_dev_types_str();
 
+  virtual std::string get_type_cache_key(const char * name);
+
 private:
   bool get_dev_list(smart_device_list & devlist, const char * pattern,
     bool scan_ata, bool scan_scsi, bool scan_nvme,
@@ -2740,6 +2802,8 @@ private:
   int megasas_dcmd_cmd(int bus_no, uint32_t opcode, void *buf,
     size_t bufsize, uint8_t *mbox, size_t mboxlen, uint8_t *statusp);
   int megasas_pd_add_list(int bus_no, smart_device_list & devlist);
+
+  struct megasas_iocpacket m_dcmd_ioc; ///< Frame reused by megasas_dcmd_cmd()
 };
 
 std::string linux_smart_interface::get_os_version_str()
@@ -2883,6 +2947,9 @@ bool linux_smart_interface::get_dev_megasas(smart_device_list & devlist)
   if(!scan_megasas)
     return false;
 
+  // keep the ioctl node open while querying all hosts
+  bool node_open = (megasas_node_open() >= 0);
+
   // getting bus numbers with megasas devices
   // we are using sysfs to get list of all scsi hosts
   DIR * dp = opendir ("/sys/class/scsi_host/");
@@ -2909,6 +2976,8 @@ bool linux_smart_interface::get_dev_megasas(smart_device_list & devlist)
     for(unsigned i = 0; i <=16; i++) // trying to add devices on first 16 buses
       megasas_pd_add_list(i, devlist);
   }
+  if (node_open)
+    megasas_node_close();
   return true;
 }
 
@@ -2988,7 +3057,7 @@ int
 linux_smart_interface::megasas_dcmd_cmd(int bus_no, uint32_t opcode, void *buf,
   size_t bufsize, uint8_t *mbox, size_t mboxlen, uint8_t *statusp)
 {
-  struct megasas_iocpacket ioc;
+  struct megasas_iocpacket & ioc = m_dcmd_ioc;
 
   if ((mbox != NULL && (mboxlen == 0 || mboxlen > MFI_MBOX_SIZE)) ||
     (mbox == NULL && mboxlen != 0)) 
@@ -3020,12 +3089,12 @@ linux_smart_interface::megasas_dcmd_cmd(int bus_no, uint32_t opcode, void *buf,
   }
 
   int fd;
-  if ((fd = ::open("/dev/megaraid_sas_ioctl_node", O_RDWR)) <= 0) {
+  if ((fd = megasas_node_open()) < 0) {
     return (errno);
   }
 
   int r = ioctl(fd, MEGASAS_IOC_FIRMWARE, &ioc);
-  ::close(fd);
+  megasas_node_close();
   if (r < 0) {
     return (r);
   }
@@ -3046,10 +3115,11 @@ linux_smart_interface::megasas_pd_add_list(int bus_no, smart_device_list & devli
 {
   /*
   * Keep fetching the list in a loop until we have a large enough
-  * buffer to hold the entire list.
+  * buffer to hold the entire list.  Start with room for MAX_SYS_PDS
+  * entries, this is sufficient for a single DCMD on all known controllers.
   */
   megasas_pd_list * list = 0;
-  for (unsigned list_size = 1024; ; ) {
+  for (unsigned list_size = sizeof(megasas_pd_list); ; ) {
     list = reinterpret_cast<megasas_pd_list *>(realloc(list, list_size));
     if (!list)
       throw std::bad_alloc();
@@ -3091,6 +3161,52 @@ static unsigned get_kernel_release()
   return x * 100000 + y * 1000 + z;
 }
 
+// Return key for type cache: sysfs device path, WWID and USB ID.
+// Only "sdX" devices are cached because only these are probed for
+// SAT or USB bridges during autodetection.
+std::string linux_smart_interface::get_type_cache_key(const char * name)
+{
+  std::string pathbuf;
+  char * p = realpath(name, (char *)0);
+  if (!p)
+    return "";
+  pathbuf = p;
+  free(p);
+
+  static const char dev_prefix[] = "/dev/";
+  if (!str_starts_with(pathbuf, dev_prefix))
+    return "";
+  std::string test_name = pathbuf.substr(strlen(dev_prefix));
+  if (!(str_starts_with(test_name, "sd") && test_name.find('/') == std::string::npos))
+    return "";
+
+  // Resolve "/sys/block/sdX/device" -> "/sys/devices/.../H:C:T:L"
+  p = realpath(strprintf("/sys/block/%s/device", test_name.c_str()).c_str(), (char *)0);
+  if (!p)
+    return "";
+  std::string key = p;
+  free(p);
+
+  // Add WWID if available, changes if another disk is attached
+  stdio_file f(strprintf("/sys/block/%s/device/wwid", test_name.c_str()).c_str(), "r");
+  char wwid[256];
+  if (f && fgets(wwid, sizeof(wwid), f)) {
+    for (char * c = wwid; *c; c++) {
+      if (*c == '\t' || *c == '\n' || *c == '\r')
+        *c = ' ';
+    }
+    std::string w = wwid;
+    w.erase(w.find_last_not_of(' ') + 1);
+    key += "," + w;
+  }
+
+  unsigned short vendor_id = 0, product_id = 0, version = 0;
+  if (get_usb_id(test_name.c_str(), vendor_id, product_id, version))
+    key += strprintf(",usb:%04x:%04x:%04x", vendor_id, product_id, version);
+
+  return key;
+}
+
 // Guess device type (ata or scsi) based on device name (Linux
 // specific) SCSI device name in linux can be sd, sr, scd, st, nst,
 // osst, nosst and sg.
@@ -546,16 +546,14 @@ smart_device * sat_device::autodetect_open()
 
 static bool has_sat_pass_through(ata_device * dev, bool packet_interface = false)
 {
-    /* Note:  malloc() ensures the read buffer lands on a single
-       page.  This avoids some bugs seen on LSI controlers under
-       FreeBSD */
-    char *data = (char *)malloc(512);
+    /* Note:  The page aligned I/O buffer ensures the read buffer lands
+       on a single page.  This avoids some bugs seen on LSI controlers
+       under FreeBSD */
+    unsigned char *data = dev->get_io_buffer(512, false);
     ata_cmd_in in;
     in.in_regs.command = (packet_interface ? ATA_IDENTIFY_PACKET_DEVICE : ATA_IDENTIFY_DEVICE);
     in.set_data_in(data, 1);
-    bool ret = dev->ata_pass_through(in);
-    free(data);
-    return ret;
+    return dev->ata_pass_through(in);
 }
 
 /////////////////////////////////////////////////////////////////////////////
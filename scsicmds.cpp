@@ -85,29 +85,37 @@ supported_vpd_pages::is_supported(int vpd_page_num) const
 /* output binary in hex and optionally ascii */
 void
 dStrHex(const char* str, int len, int no_ascii)
+{
+    dStrHexAddr(str, len, no_ascii, 0);
+}
+
+/* output binary in hex and optionally ascii, first line has address
+ * 'addr'. Addresses with more than 6 digits move the columns right. */
+void
+dStrHexAddr(const char* str, int len, int no_ascii, uint64_t addr)
 {
     const char* p = str;
-    char buff[82];
-    int a = 0;
+    char buff[90];
+    uint64_t a = addr;
     const int bpstart = 5;
     const int cpstart = 60;
-    int cpos = cpstart;
-    int bpos = bpstart;
+    int off, cpos, bpos;
     int i, k;
 
     if (len <= 0) return;
-    memset(buff,' ',80);
-    buff[80]='\0';
-    k = snprintf(buff+1, sizeof(buff)-1, "%.2x", a);
+    memset(buff,' ',88);
+    buff[88]='\0';
+    k = snprintf(buff+1, sizeof(buff)-1, "%.2" PRIx64, a);
     buff[k + 1] = ' ';
-    if (bpos >= ((bpstart + (9 * 3))))
-        bpos++;
+    off = (k > 6 ? k - 6 : 0);
+    bpos = bpstart + off;
+    cpos = cpstart + off;
 
     for(i = 0; i < len; i++)
     {
         unsigned char c = *p++;
         bpos += 3;
-        if (bpos == (bpstart + (9 * 3)))
+        if (bpos == (bpstart + off + (9 * 3)))
             bpos++;
         snprintf(buff+bpos, sizeof(buff)-bpos, "%.2x", (int)(unsigned char)c);
         buff[bpos + 2] = ' ';
@@ -118,21 +126,22 @@ dStrHex(const char* str, int len, int no_ascii)
                 c='.';
             buff[cpos++] = c;
         }
-        if (cpos > (cpstart+15))
+        if (cpos > (cpstart+off+15))
         {
             while (cpos > 0 && buff[cpos-1] == ' ')
               cpos--;
             buff[cpos] = 0;
             pout("%s\n", buff);
-            bpos = bpstart;
-            cpos = cpstart;
             a += 16;
-            memset(buff,' ',80);
-            k = snprintf(buff+1, sizeof(buff)-1, "%.2x", a);
+            memset(buff,' ',88);
+            k = snprintf(buff+1, sizeof(buff)-1, "%.2" PRIx64, a);
             buff[k + 1] = ' ';
+            off = (k > 6 ? k - 6 : 0);
+            bpos = bpstart + off;
+            cpos = cpstart + off;
         }
     }
-    if (cpos > cpstart)
+    if (cpos > cpstart+off)
     {
         while (cpos > 0 && buff[cpos-1] == ' ')
           cpos--;
@@ -447,7 +456,11 @@ scsi_decode_lu_dev_id(const unsigned char * b, int blen, char * s, int slen,
    first to deduce the response length, then send the same command again
    requesting the deduced response length. This protects certain fragile
    HBAs. The twin fetch technique should not be used with the TapeAlert
-   log page since it clears its state flags after each fetch. */
+   log page since it clears its state flags after each fetch.
+   The response length deduced for subpage 0 is cached in the device
+   object, later calls with known_resp_len == 0 then do a single fetch.
+   The cache entry is invalidated on error. If a single fetch with a
+   cached length fails, the twin fetch is used for this page again. */
 int
 scsiLogSense(scsi_device * device, int pagenum, int subpagenum, UINT8 *pBuf,
              int bufLen, int known_resp_len)
@@ -457,11 +470,16 @@ scsiLogSense(scsi_device * device, int pagenum, int subpagenum, UINT8 *pBuf,
     UINT8 cdb[10];
     UINT8 sense[32];
     int pageLen;
+    int cachedLen = 0;
 
     if (known_resp_len > bufLen)
         return -EIO;
+    if (known_resp_len <= 0 && 0 == subpagenum)
+        cachedLen = device->get_log_page_len(pagenum);
     if (known_resp_len > 0)
         pageLen = known_resp_len;
+    else if (cachedLen > 0)
+        pageLen = (cachedLen < bufLen ? cachedLen : bufLen);
     else {
         /* Starting twin fetch strategy: first fetch to find respone length */
         pageLen = 4;
@@ -522,17 +540,40 @@ scsiLogSense(scsi_device * device, int pagenum, int subpagenum, UINT8 *pBuf,
     io_hdr.max_sense_len = sizeof(sense);
     io_hdr.timeout = SCSI_TIMEOUT_DEFAULT;
 
+    int status = 0;
     if (!device->scsi_pass_through(&io_hdr))
-      return -device->get_errno();
-    scsi_do_sense_disect(&io_hdr, &sinfo);
-    int status = scsiSimpleSenseFilter(&sinfo);
-    if (0 != status)
+        status = -device->get_errno();
+    else {
+        scsi_do_sense_disect(&io_hdr, &sinfo);
+        status = scsiSimpleSenseFilter(&sinfo);
+        /* sanity check on response */
+        if (0 == status && (SUPPORTED_LPAGES != pagenum) &&
+            ((pBuf[0] & 0x3f) != pagenum))
+            status = SIMPLE_ERR_BAD_RESP;
+        if (0 == status && 0 == ((pBuf[2] << 8) + pBuf[3]))
+            status = SIMPLE_ERR_BAD_RESP;
+    }
+    if (known_resp_len > 0 || 0 != subpagenum || cachedLen < 0)
         return status;
-    /* sanity check on response */
-    if ((SUPPORTED_LPAGES != pagenum) && ((pBuf[0] & 0x3f) != pagenum))
-        return SIMPLE_ERR_BAD_RESP;
-    if (0 == ((pBuf[2] << 8) + pBuf[3]))
-        return SIMPLE_ERR_BAD_RESP;
+
+    if (0 != status) {
+        /* fall back to twin fetch if the cached length was not accepted,
+         * other errors (e.g. NOT READY, transport) only invalidate it */
+        if (cachedLen > 0 && (SIMPLE_ERR_BAD_RESP == status ||
+                              SIMPLE_ERR_BAD_FIELD == status))
+            device->set_log_page_len(pagenum, -1);
+        else
+            device->set_log_page_len(pagenum, 0);
+        return status;
+    }
+    int respLen = (pBuf[2] << 8) + pBuf[3] + 4;
+    if (respLen % 2)
+        respLen += 1;
+    device->set_log_page_len(pagenum, respLen);
+    /* page has grown since length was cached (e.g. new log entries) */
+    if (cachedLen > 0 && respLen > pageLen && pageLen < bufLen)
+        return scsiLogSense(device, pagenum, subpagenum, pBuf, bufLen,
+                            (respLen < bufLen ? respLen : bufLen));
     return 0;
 }
 
@@ -1111,6 +1152,108 @@ scsiReadDefect12(scsi_device * device, int req_plist, int req_glist,
     return scsiSimpleSenseFilter(&sinfo);
 }
 
+/* Returns length in bytes of an address descriptor in defect list
+ * format 'dl_format' or 0 if unknown. SBC-3 section 6.1 (rev 35) */
+int
+scsiDefectDescLen(int dl_format)
+{
+    switch (dl_format) {
+        case 0:     /* short block */
+            return 4;
+        case 1:     /* extended bytes from index */
+        case 2:     /* extended physical sector */
+        case 3:     /* long block */
+        case 4:     /* bytes from index */
+        case 5:     /* physical sector */
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+/* Reads the primary (req_plist) and/or grown (req_glist) defect list.
+ * The header is decoded into 'dlip'. If 'cb' is not NULL, the address
+ * descriptors are read in chunks which fit into 'pBuf' (using the
+ * ADDRESS DESCRIPTOR INDEX field of READ DEFECT DATA (12)) and passed
+ * to 'cb'. So memory use is bounded even if the list has hundreds of
+ * thousands of entries. Falls back to READ DEFECT DATA (10) if (12) is
+ * not supported, then at most one buffer of descriptors is returned.
+ * 'bufLen' must be at least 8. Returns 0 if ok, 8 (TRY AGAIN) if the list
+ * generation changed while reading, otherwise as scsiReadDefect12(). */
+int
+scsiReadDefectList(scsi_device * device, int req_plist, int req_glist,
+                   int dl_format, struct scsi_defect_list_info * dlip,
+                   scsi_defect_desc_cb cb, void * cb_arg,
+                   UINT8 *pBuf, int bufLen)
+{
+    int err, hdr_len;
+
+    memset(dlip, 0, sizeof(*dlip));
+    if (bufLen < 8)
+        return -EINVAL;
+    memset(pBuf, 0, 8);
+    err = scsiReadDefect12(device, req_plist, req_glist, dl_format, 0,
+                           pBuf, 8);
+    if (SIMPLE_ERR_BAD_OPCODE == err) {
+        if ((err = scsiReadDefect10(device, req_plist, req_glist, dl_format,
+                                    pBuf, 4)))
+            return err;
+        hdr_len = 4;
+        dlip->list_len = (pBuf[2] << 8) + pBuf[3];
+    } else if (err)
+        return err;
+    else {
+        hdr_len = 8;
+        dlip->got_rd12 = 1;
+        dlip->generation = (pBuf[2] << 8) + pBuf[3];
+        dlip->list_len = ((unsigned int)pBuf[4] << 24) + (pBuf[5] << 16) +
+                         (pBuf[6] << 8) + pBuf[7];
+    }
+    dlip->plist = !!(pBuf[1] & 0x10);
+    dlip->glist = !!(pBuf[1] & 0x8);
+    dlip->format = pBuf[1] & 0x7;
+    dlip->desc_len = scsiDefectDescLen(dlip->format);
+    if (dlip->desc_len)
+        dlip->num = dlip->list_len / dlip->desc_len;
+
+    if (!cb || 0 == dlip->num)
+        return 0;
+
+    unsigned int max_num = (bufLen - hdr_len) / dlip->desc_len;
+    if (0 == max_num)
+        return -EINVAL;
+
+    if (!dlip->got_rd12) {
+        /* READ DEFECT DATA (10) has no index, list is truncated */
+        unsigned int n = (dlip->num < max_num ? dlip->num : max_num);
+        if (n > (0xffff - 4) / (unsigned)dlip->desc_len)
+            n = (0xffff - 4) / dlip->desc_len;
+        if ((err = scsiReadDefect10(device, req_plist, req_glist,
+                                    dl_format, pBuf,
+                                    hdr_len + n * dlip->desc_len)))
+            return err;
+        cb(pBuf + hdr_len, n, dlip, cb_arg);
+        return 0;
+    }
+
+    for (unsigned int index = 0; index < dlip->num; ) {
+        unsigned int n = dlip->num - index;
+        if (n > max_num)
+            n = max_num;
+        if ((err = scsiReadDefect12(device, req_plist, req_glist, dl_format,
+                                    index, pBuf, hdr_len + n * dlip->desc_len)))
+            return err;
+        /* Restart is up to the caller if the list has changed */
+        if ((((pBuf[2] << 8) + pBuf[3]) != dlip->generation) ||
+            ((pBuf[1] & 0x7) != dlip->format))
+            return SIMPLE_ERR_TRY_AGAIN;
+        if (cb(pBuf + hdr_len, n, dlip, cb_arg))
+            break;
+        index += n;
+    }
+    return 0;
+}
+
 /* READ CAPACITY (10) command. Returns 0 if ok, 1 if NOT READY, 2 if
  * command not supported, 3 if field in command not supported or returns
  * negated errno. SBC-3 section 5.15 (rev 26) */
@@ -2288,6 +2431,57 @@ scsiDecodeNonMediumErrPage(unsigned char *resp,
     }
 }
 
+/* Decodes the error counters of all phys from the SAS Protocol Specific
+ * log page (0x18) in 'resp' of 'len' bytes. Stores up to 'max_phys'
+ * entries in 'phys'. Returns the number of phys stored or -1 if this is
+ * not a SAS log page. See SPL-3 section 9.2.7.2 */
+int
+scsiDecodeSasPhyCounters(const unsigned char * resp, int len,
+                         struct scsiSasPhyCounters * phys, int max_phys)
+{
+    int k, num, nphys = 0;
+    const unsigned char * ucp;
+
+    if (len < 4 || (resp[0] & 0x3f) != PROTOCOL_SPECIFIC_LPAGE)
+        return -1;
+    num = (resp[2] << 8) + resp[3];
+    if (num > len - 4)
+        num = len - 4;
+    for (k = 0, ucp = resp + 4; k + 8 <= num; ) {
+        int param_len = ucp[3] + 4;
+        if (6 != (0xf & ucp[4]))
+            return -1;  /* only SAS */
+        if (param_len > num - k)
+            param_len = num - k;
+        int port = (ucp[0] << 8) | ucp[1];
+        const unsigned char * vcp = ucp + 8;
+        for (int j = 0, spld_len; j + 48 <= param_len - 8;
+             vcp += spld_len, j += spld_len) {
+            spld_len = vcp[3];
+            if (spld_len < 44)
+                spld_len = 48;  /* in SAS-1 and SAS-1.1 vcp[3]==0 */
+            else
+                spld_len += 4;
+            if (nphys >= max_phys)
+                return nphys;
+            struct scsiSasPhyCounters * pcp = phys + nphys++;
+            pcp->port = port;
+            pcp->phy_id = vcp[1];
+            pcp->inv_dword = ((unsigned int)vcp[32] << 24) | (vcp[33] << 16) |
+                             (vcp[34] << 8) | vcp[35];
+            pcp->disparity = ((unsigned int)vcp[36] << 24) | (vcp[37] << 16) |
+                             (vcp[38] << 8) | vcp[39];
+            pcp->loss_sync = ((unsigned int)vcp[40] << 24) | (vcp[41] << 16) |
+                             (vcp[42] << 8) | vcp[43];
+            pcp->reset_prob = ((unsigned int)vcp[44] << 24) | (vcp[45] << 16) |
+                              (vcp[46] << 8) | vcp[47];
+        }
+        k += param_len;
+        ucp += param_len;
+    }
+    return nphys;
+}
+
 /* Counts number of failed self-tests. Also encodes the poweron_hour
    of the most recent failed self-test. Return value is negative if
    this function has a problem (typically -1), otherwise the bottom 8
@@ -2344,6 +2538,152 @@ scsiCountFailedSelfTests(scsi_device * fd, int noisy)
     return (fail_hour << 8) + fails;
 }
 
+/* Reads the self-test results log page and decodes only the entries
+ * newer than the completed entry identified by 'stp->last_key'. If the
+ * key is 0 or not found (log wrapped), all entries are new. The key is
+ * not unique if the same self-test completes with the same result
+ * within one power-on hour, so 'stp->last_count' entries with this key
+ * are considered old, further ones are new. Entries of self-tests in
+ * progress are skipped. On return, 'stp->last_key' and
+ * 'stp->last_count' identify the newest completed entry and the other
+ * fields of 'stp' describe the new entries. Returns 0 if ok, else -1. */
+int
+scsiTrackSelfTests(scsi_device * fd, struct scsi_selftest_track * stp,
+                   int noisy)
+{
+    int num, k, err, nent, same;
+    unsigned int newest_key = 0;
+    unsigned int keys[20];
+    bool done[20];
+    UINT8 * ucp;
+    unsigned char resp[LOG_RESP_SELF_TEST_LEN];
+
+    stp->new_entries = stp->new_fails = stp->fail_hour = 0;
+    stp->newest_result = -1;
+    if ((err = scsiLogSense(fd, SELFTEST_RESULTS_LPAGE, 0, resp,
+                            LOG_RESP_SELF_TEST_LEN, 0))) {
+        if (noisy)
+            pout("scsiTrackSelfTests Failed [%s]\n", scsiErrString(err));
+        return -1;
+    }
+    if ((resp[0] & 0x3f) != SELFTEST_RESULTS_LPAGE) {
+        if (noisy)
+            pout("Self-test Log Sense Failed, page mismatch\n");
+        return -1;
+    }
+    num = (resp[2] << 8) + resp[3];
+    if (num != 0x190) {
+        if (noisy)
+            pout("Self-test Log Sense length is 0x%x not 0x190 bytes\n", num);
+        return -1;
+    }
+    // key: power-on hours, self-test number, self-test code and result
+    same = 0;
+    for (k = 0, ucp = resp + 4; k < 20; ++k, ucp += 20) {
+        int n = (ucp[6] << 8) | ucp[7];
+        if ((0 == n) && (0 == ucp[4]))
+            break;
+        keys[k] = ((unsigned int)n << 16) | (ucp[5] << 8) | ucp[4];
+        done[k] = ((ucp[4] & 0xf) != 0xf);  // not in progress
+        if (done[k] && keys[k] == stp->last_key)
+            same++;
+    }
+    nent = k;
+    // number of new entries with same key as last seen entry, these
+    // are newer than the old ones
+    same -= stp->last_count;
+
+    // newest entry first, stop at last seen entry
+    for (k = 0, ucp = resp + 4; k < nent; ++k, ucp += 20) {
+        if (!done[k])
+            continue;
+        if (keys[k] == stp->last_key && same-- <= 0)
+            break;
+        int res = ucp[4] & 0xf;
+        if (!newest_key) {
+            newest_key = keys[k];
+            stp->newest_result = res;
+        }
+        stp->new_entries++;
+        if ((res > 2) && (res < 8)) {
+            if (0 == stp->new_fails++)
+                stp->fail_hour = (ucp[6] << 8) | ucp[7];
+        }
+    }
+    if (newest_key)
+        stp->last_key = newest_key;
+    stp->last_count = 0;
+    for (k = 0; k < nent; ++k) {
+        if (done[k] && keys[k] == stp->last_key)
+            stp->last_count++;
+    }
+    return 0;
+}
+
+/* Reads the background scan results log page and decodes the medium
+ * scan entries newer than 'btp->last_key'. Entries are ordered by
+ * accumulated power-on minutes and parameter code, so this also works
+ * if the device reuses parameter codes. 'pBuf' should hold the
+ * complete page (up to 2048 entries of 24 bytes). On return,
+ * 'btp->last_key' identifies the newest entry and the other fields of
+ * 'btp' describe the new entries. Returns 0 if ok, else error as
+ * scsiLogSense() or SIMPLE_ERR_BAD_RESP. */
+int
+scsiTrackBackgroundResults(scsi_device * device, struct scsi_bms_track * btp,
+                           UINT8 * pBuf, int bufLen)
+{
+    int num, err;
+    uint64_t newest_key = btp->last_key, newest_err_key = 0;
+    UINT8 * ucp;
+
+    btp->new_entries = btp->new_errors = btp->new_unrecovered = 0;
+    if ((err = scsiLogSense(device, BACKGROUND_RESULTS_LPAGE, 0, pBuf,
+                            bufLen, 0)))
+        return err;
+    if ((pBuf[0] & 0x3f) != BACKGROUND_RESULTS_LPAGE)
+        return SIMPLE_ERR_BAD_RESP;
+    num = (pBuf[2] << 8) + pBuf[3] + 4;
+    if (num > bufLen)
+        num = bufLen;
+    ucp = pBuf + 4;
+    num -= 4;
+    while (num > 3) {
+        int pc = (ucp[0] << 8) | ucp[1];
+        int pl = ucp[3] + 4;
+        if ((pc > 0) && (pc <= 0x800) && (pl >= 24) && (num >= 24)) {
+            unsigned int minutes = ((unsigned int)ucp[4] << 24) +
+                                   (ucp[5] << 16) + (ucp[6] << 8) + ucp[7];
+            uint64_t key = ((uint64_t)minutes << 16) | pc;
+            if (key > btp->last_key) {
+                int sk = ucp[8] & 0xf;
+                int rs = (ucp[8] >> 4) & 0xf;
+                btp->new_entries++;
+                if ((SCSI_SK_MEDIUM_ERROR == sk) ||
+                    (SCSI_SK_HARDWARE_ERROR == sk)) {
+                    btp->new_errors++;
+                    /* not reassigned (2), rewritten (5) or by app (6, 7) */
+                    if (!((2 == rs) || (5 == rs) || (6 == rs) || (7 == rs)))
+                        btp->new_unrecovered++;
+                    if (key > newest_err_key) {
+                        newest_err_key = key;
+                        btp->error_minutes = minutes;
+                        btp->error_lba = 0;
+                        for (int m = 0; m < 8; ++m)
+                            btp->error_lba = (btp->error_lba << 8) +
+                                             ucp[16 + m];
+                    }
+                }
+                if (key > newest_key)
+                    newest_key = key;
+            }
+        }
+        num -= pl;
+        ucp += pl;
+    }
+    btp->last_key = newest_key;
+    return 0;
+}
+
 /* Returns 0 if able to read self test log page; then outputs 1 into
    *inProgress if self test still in progress, else outputs 0. */
 int
@@ -168,6 +168,58 @@ struct scsiNonMediumError {
     uint64_t counterPE_H;  /* Positioning errors [Hitachi] */
 };
 
+/* Header info of defect list returned by scsiReadDefectList() */
+struct scsi_defect_list_info {
+    UINT8 got_rd12;     /* 1 if READ DEFECT DATA (12) used */
+    UINT8 plist;        /* 1 if primary list returned */
+    UINT8 glist;        /* 1 if grown list returned */
+    UINT8 format;       /* defect list format returned by device */
+    int generation;     /* list generation (RD12 only), 0 if unknown */
+    unsigned int list_len;  /* defect list length in bytes */
+    int desc_len;       /* bytes per address descriptor, 0 if unknown */
+    unsigned int num;   /* number of address descriptors, 0 if unknown */
+};
+
+/* Called by scsiReadDefectList() for each chunk of 'num' address
+ * descriptors starting at 'desc'. Return non-zero to stop reading. */
+typedef int (*scsi_defect_desc_cb)(const UINT8 * desc, unsigned int num,
+                                   const struct scsi_defect_list_info * dlip,
+                                   void * arg);
+
+/* Incremental tracking of self-test results log page, see
+ * scsiTrackSelfTests() */
+struct scsi_selftest_track {
+    unsigned int last_key;  /* key of newest completed entry, 0 if none */
+    int last_count;         /* number of entries with key 'last_key' */
+    int new_entries;        /* number of new completed entries */
+    int new_fails;          /* number of new failed self-tests */
+    int fail_hour;          /* power-on hours of newest new failure */
+    int newest_result;      /* result of newest new entry, -1 if none */
+};
+
+/* Incremental tracking of medium scan entries in background scan
+ * results log page, see scsiTrackBackgroundResults() */
+struct scsi_bms_track {
+    uint64_t last_key;      /* (power-on minutes << 16) + parameter code
+                             * of newest entry, 0 if none */
+    int new_entries;        /* number of new medium scan entries */
+    int new_errors;         /* ... with MEDIUM or HARDWARE ERROR */
+    int new_unrecovered;    /* ... which are not reassigned or rewritten */
+    uint64_t error_lba;     /* LBA of newest new error */
+    unsigned int error_minutes; /* power-on minutes of newest new error */
+};
+
+/* Carrier for error counters of one phy from SAS Protocol Specific log
+ * page */
+struct scsiSasPhyCounters {
+    int port;                   /* relative target port identifier */
+    int phy_id;                 /* phy identifier */
+    unsigned int inv_dword;     /* invalid DWORD count */
+    unsigned int disparity;     /* running disparity error count */
+    unsigned int loss_sync;     /* loss of DWORD synchronization count */
+    unsigned int reset_prob;    /* phy reset problem count */
+};
+
 /* SCSI Peripheral types (of interest) */
 #define SCSI_PT_DIRECT_ACCESS           0x0
 #define SCSI_PT_SEQUENTIAL_ACCESS       0x1
@@ -389,6 +441,13 @@ int scsiReadDefect10(scsi_device * device, int req_plist, int req_glist, int dl_
 int scsiReadDefect12(scsi_device * device, int req_plist, int req_glist,
                      int dl_format, int addrDescIndex, UINT8 *pBuf, int bufLen);
 
+int scsiDefectDescLen(int dl_format);
+
+int scsiReadDefectList(scsi_device * device, int req_plist, int req_glist,
+                       int dl_format, struct scsi_defect_list_info * dlip,
+                       scsi_defect_desc_cb cb, void * cb_arg,
+                       UINT8 *pBuf, int bufLen);
+
 int scsiReadCapacity10(scsi_device * device, unsigned int * last_lbp,
                        unsigned int * lb_sizep);
 
@@ -408,9 +467,16 @@ void scsiDecodeErrCounterPage(unsigned char * resp,
                               struct scsiErrorCounter *ecp);
 void scsiDecodeNonMediumErrPage(unsigned char * resp,
                                 struct scsiNonMediumError *nmep);
+int scsiDecodeSasPhyCounters(const unsigned char * resp, int len,
+                             struct scsiSasPhyCounters * phys, int max_phys);
 int scsiFetchExtendedSelfTestTime(scsi_device * device, int * durationSec,
                                   int modese_len);
 int scsiCountFailedSelfTests(scsi_device * device, int noisy);
+int scsiTrackSelfTests(scsi_device * device, struct scsi_selftest_track * stp,
+                       int noisy);
+int scsiTrackBackgroundResults(scsi_device * device,
+                               struct scsi_bms_track * btp,
+                               UINT8 * pBuf, int bufLen);
 int scsiSelfTestInProgress(scsi_device * device, int * inProgress);
 int scsiFetchControlGLTSD(scsi_device * device, int modese_len, int current);
 int scsiSetControlGLTSD(scsi_device * device, int enabled, int modese_len);
@@ -444,6 +510,9 @@ void scsi_format_id_string(char * out, const unsigned char * in, int n);
 void dStrHex(const char* str, int len, int no_ascii);
 inline void dStrHex(const unsigned char* str, int len, int no_ascii)
   { dStrHex((const char *)str, len, no_ascii); }
+void dStrHexAddr(const char* str, int len, int no_ascii, uint64_t addr);
+inline void dStrHexAddr(const unsigned char* str, int len, int no_ascii, uint64_t addr)
+  { dStrHexAddr((const char *)str, len, no_ascii, addr); }
 
 /* Attempt to find the first SCSI sense data descriptor that matches the
    given 'desc_type'. If found return pointer to start of sense data
@@ -327,85 +327,156 @@ scsiGetStartStopData(scsi_device * device)
 static void
 scsiPrintGrownDefectListLen(scsi_device * device)
 {
-    int err, dl_format, got_rd12;
-    unsigned int dl_len, div;
-
-    memset(gBuf, 0, 8);
-    if ((err = scsiReadDefect12(device, 0 /* req_plist */, 1 /* req_glist */,
-                                4 /* format: bytes from index */,
-                                0 /* addr desc index */, gBuf, 8))) {
-        if (2 == err) { /* command not supported */
-            if ((err = scsiReadDefect10(device, 0 /* req_plist */, 1 /* req_glist */,
-                                        4 /* format: bytes from index */, gBuf, 4))) {
-                if (scsi_debugmode > 0) {
-                    print_on();
-                    pout("Read defect list (10) Failed: %s\n", scsiErrString(err));
-                    print_off();
-                }
-                return;
-            } else
-                got_rd12 = 0;
-        } else if (101 == err)    /* Defect list not found, leave quietly */
-            return;
-        else {
-            if (scsi_debugmode > 0) {
-                print_on();
-                pout("Read defect list (12) Failed: %s\n", scsiErrString(err));
-                print_off();
-            }
-            return;
-        }
-    } else
-        got_rd12 = 1;
+    int err;
+    struct scsi_defect_list_info dli;
 
-    if (got_rd12) {
-        int generation = (gBuf[2] << 8) + gBuf[3];
-        if ((generation > 1) && (scsi_debugmode > 0)) {
+    /* Header only, format: bytes from index */
+    if ((err = scsiReadDefectList(device, 0 /* req_plist */, 1 /* req_glist */,
+                                  4 /* format */, &dli, NULL, NULL, gBuf, 8))) {
+        if (101 == err)    /* Defect list not found, leave quietly */
+            return;
+        if (scsi_debugmode > 0) {
             print_on();
-            pout("Read defect list (12): generation=%d\n", generation);
+            pout("Read defect list Failed: %s\n", scsiErrString(err));
             print_off();
         }
-        dl_len = (gBuf[4] << 24) + (gBuf[5] << 16) + (gBuf[6] << 8) + gBuf[7];
-    } else {
-        dl_len = (gBuf[2] << 8) + gBuf[3];
+        return;
+    }
+
+    if ((dli.generation > 1) && (scsi_debugmode > 0)) {
+        print_on();
+        pout("Read defect list (12): generation=%d\n", dli.generation);
+        print_off();
     }
-    if (0x8 != (gBuf[1] & 0x18)) {
+    if (!dli.glist || dli.plist) {
         print_on();
         pout("Read defect list: asked for grown list but didn't get it\n");
         print_off();
         return;
     }
-    div = 0;
-    dl_format = (gBuf[1] & 0x7);
-    switch (dl_format) {
+    if (0 == dli.desc_len) {
+        print_on();
+        pout("defect list format %d unknown\n", dli.format);
+        print_off();
+    }
+    if (0 == dli.list_len)
+        pout("Elements in grown defect list: 0\n\n");
+    else {
+        if (0 == dli.desc_len)
+            pout("Grown defect list length=%u bytes [unknown "
+                 "number of elements]\n\n", dli.list_len);
+        else
+            pout("Elements in grown defect list: %u\n\n", dli.num);
+    }
+}
+
+static const char * const defect_format_names[8] = {
+    "short block", "extended bytes from index", "extended physical sector",
+    "long block", "bytes from index", "physical sector", "vendor specific",
+    "reserved"
+};
+
+/* Prints one chunk of address descriptors, called by scsiReadDefectList() */
+static int
+scsiPrintDefectDescs(const UINT8 * desc, unsigned int num,
+                     const struct scsi_defect_list_info * dlip, void * arg)
+{
+    unsigned int * index = (unsigned int *)arg;
+
+    for (unsigned int i = 0; i < num; ++i, ++*index,
+                                      desc += dlip->desc_len) {
+        switch (dlip->format) {
         case 0:     /* short block */
-            div = 4;
-            break;
-        case 1:     /* extended bytes from index */
-        case 2:     /* extended physical sector */
-            /* extended = 1; # might use in future */
-            div = 8;
+            pout("%8u  %10u\n", *index, ((unsigned int)desc[0] << 24) +
+                 (desc[1] << 16) + (desc[2] << 8) + desc[3]);
             break;
         case 3:     /* long block */
-        case 4:     /* bytes from index */
-        case 5:     /* physical sector */
-            div = 8;
+            {
+                uint64_t lba = 0;
+                for (int k = 0; k < 8; ++k)
+                    lba = (lba << 8) + desc[k];
+                pout("%8u  %20" PRIu64 "\n", *index, lba);
+            }
             break;
-        default:
-            print_on();
-            pout("defect list format %d unknown\n", dl_format);
-            print_off();
+        default:    /* cylinder, head, bytes from index or sector */
+            {
+                unsigned int cyl = (desc[0] << 16) + (desc[1] << 8) + desc[2];
+                unsigned int val = ((unsigned int)desc[4] << 24) +
+                                   (desc[5] << 16) + (desc[6] << 8) + desc[7];
+                bool mads = false;
+                if (dlip->format <= 2) { /* extended formats */
+                    mads = !!(desc[4] & 0x80);
+                    val &= 0x0fffffff;
+                }
+                if (0xffffffff == val)
+                    pout("%8u  %8u  %4u  %10s\n", *index, cyl, desc[3],
+                         "all");
+                else
+                    pout("%8u  %8u  %4u  %10u%s\n", *index, cyl, desc[3],
+                         val, (mads ? "  MADS" : ""));
+            }
             break;
+        }
     }
-    if (0 == dl_len)
-        pout("Elements in grown defect list: 0\n\n");
-    else {
-        if (0 == div)
-            pout("Grown defect list length=%u bytes [unknown "
-                 "number of elements]\n\n", dl_len);
-        else
-            pout("Elements in grown defect list: %u\n\n", dl_len / div);
+    return 0;
+}
+
+/* Prints the primary (plist) or grown defect list. Returns 0 if ok,
+ * or FAILSMART. */
+static int
+scsiPrintDefectList(scsi_device * device, int plist)
+{
+    int err, dl_format;
+    unsigned int index = 0;
+    struct scsi_defect_list_info dli;
+    const char * name = (plist ? "Primary" : "Grown");
+
+    /* Ask for long block format, device may return another one */
+    dl_format = 3;
+    if ((err = scsiReadDefectList(device, plist, !plist, dl_format, &dli,
+                                  NULL, NULL, gBuf, 8))) {
+        if (101 == err) {
+            pout("%s defect list not found\n\n", name);
+            return 0;
+        }
+        print_on();
+        pout("Read %s defect list failed: %s\n\n", name,
+             scsiErrString(err));
+        print_off();
+        return FAILSMART;
+    }
+    if (0 == dli.desc_len) {
+        pout("%s defect list: %u bytes in unknown format %d\n\n", name,
+             dli.list_len, dli.format);
+        return 0;
+    }
+    pout("%s defect list (%s format): %u entries\n", name,
+         defect_format_names[dli.format], dli.num);
+    if (0 == dli.num) {
+        pout("\n");
+        return 0;
     }
+    if (dli.format == 0 || dli.format == 3)
+        pout("%8s  %*s\n", "Index", (dli.format == 0 ? 10 : 20), "LBA");
+    else
+        pout("%8s  %8s  %4s  %10s\n", "Index", "Cylinder", "Head",
+             (dli.format == 1 || dli.format == 4 ? "Bytes" : "Sector"));
+
+    /* Read again with the format returned, in chunks of gBuf size */
+    if ((err = scsiReadDefectList(device, plist, !plist, dli.format, &dli,
+                                  scsiPrintDefectDescs, &index,
+                                  gBuf, sizeof(gBuf)))) {
+        print_on();
+        pout("Read %s defect list failed at entry %u: %s\n\n", name, index,
+             scsiErrString(err));
+        print_off();
+        return FAILSMART;
+    }
+    if (index < dli.num)
+        pout("[%u of %u entries shown, READ DEFECT DATA (12) not supported]\n",
+             index, dli.num);
+    pout("\n");
+    return 0;
 }
 
 static void
@@ -2005,7 +2076,7 @@ scsiPrintMain(scsi_device * device, const scsi_print_options & options)
     if (options.smart_check_status  || options.smart_ss_media_log ||
         options.smart_vendor_attrib || options.smart_error_log ||
         options.smart_selftest_log  || options.smart_background_log ||
-        options.sasphy)
+        options.sasphy || options.defect_plist || options.defect_glist)
         pout("=== START OF READ SMART DATA SECTION ===\n");
 
     if (options.smart_check_status) {
@@ -2094,6 +2165,13 @@ scsiPrintMain(scsi_device * device, const scsi_print_options & options)
             failuretest(OPTIONAL_CMD, returnval|=res);
         any_output = true;
     }
+    if ((options.defect_plist || options.defect_glist) && is_disk) {
+        if (options.defect_plist && (res = scsiPrintDefectList(device, 1)))
+            failuretest(OPTIONAL_CMD, returnval|=res);
+        if (options.defect_glist && (res = scsiPrintDefectList(device, 0)))
+            failuretest(OPTIONAL_CMD, returnval|=res);
+        any_output = true;
+    }
     if (options.smart_default_selftest) {
         if (scsiSmartDefaultSelfTest(device))
             return returnval | FAILSMART;
@@ -41,6 +41,7 @@ struct scsi_print_options
   bool smart_selftest_log;
   bool smart_background_log;
   bool smart_ss_media_log;
+  bool defect_plist, defect_glist; // Print primary/grown defect list
 
   bool smart_disable, smart_enable;
   bool smart_auto_save_disable, smart_auto_save_enable;
@@ -64,6 +65,7 @@ struct scsi_print_options
       smart_selftest_log(false),
       smart_background_log(false),
       smart_ss_media_log(false),
+      defect_plist(false), defect_glist(false),
       smart_disable(false), smart_enable(false),
       smart_auto_save_disable(false), smart_auto_save_enable(false),
       smart_default_selftest(false),
@@ -0,0 +1,487 @@
+/*
+ * smartbench.cpp
+ *
+ * Home page of code is: http://www.smartmontools.org
+ *
+ * Copyright (C) 2026 Smartmontools developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * (for example COPYING); If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Micro-benchmarks for CPU bound code paths.
+// Not installed, build and run with 'make bench'.
+
+#include "config.h"
+#include "int64.h"
+#include "atacmds.h"
+#include "dev_interface.h"
+#include "knowndrives.h"
+#include "scsicmds.h"
+#include "utility.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <string>
+#include <vector>
+
+const char * smartbench_cpp_cvsid = "$Id$";
+
+// Required by atacmds.cpp, scsiata.cpp
+unsigned char failuretest_permissive = 0;
+
+void pout(const char * fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  fflush(stdout);
+}
+
+void checksumwarning(const char * string)
+{
+  pout("Warning! %s error: invalid SMART checksum.\n", string);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Allocation counter
+
+static unsigned long alloc_count = 0;
+
+void * operator new(size_t size)
+{
+  alloc_count++;
+  void * p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void * p) throw()
+{
+  free(p);
+}
+
+#if __cplusplus >= 201402L
+void operator delete(void * p, size_t /*size*/) throw()
+{
+  free(p);
+}
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Test data
+
+// Set string field of identify data, swaps bytes like the device does
+static void set_id_string(unsigned char * out, const char * in, int n)
+{
+  int len = strlen(in);
+  for (int i = 0; i < n; i++)
+    out[i ^ 1] = (i < len ? in[i] : ' ');
+}
+
+static void init_identify(ata_identify_device & id, const char * model,
+  const char * firmware)
+{
+  memset(&id, 0, sizeof(id));
+  set_id_string(id.model, model, sizeof(id.model));
+  set_id_string(id.fw_rev, firmware, sizeof(id.fw_rev));
+  set_id_string(id.serial_no, "BENCH0123456789", sizeof(id.serial_no));
+  id.command_set_2 = 0x4400; // 48-bit supported
+  id.words088_255[100-88] = 0x5e00; // LBA48 capacity: 0x1d1c0be00 (4 TB)
+  id.words088_255[101-88] = 0xd1c0;
+  id.words088_255[102-88] = 0x0001;
+  id.words088_255[106-88] = 0x6003; // 4 logical sectors per physical sector
+}
+
+// Drive database lookup: hit near start, hit near end, miss
+static const char * const bench_models[][2] = {
+  { "ST3000DM001-1CH166", "CC27" },
+  { "WDC WD40EFRX-68WT0N0", "80.00A80" },
+  { "BENCH UNKNOWN MODEL 4000GB", "1.0" }
+};
+
+const unsigned num_bench_models = sizeof(bench_models) / sizeof(bench_models[0]);
+
+// USB ID lookup: hit near start, hit with bcd_device, hit near end, miss
+static const int bench_usb_ids[][3] = {
+  { 0x0480, 0xa007, -1 },
+  { 0x152d, 0x0539, 0x0205 },
+  { 0x4971, 0xce17, -1 },
+  { 0x1234, 0x5678, -1 }
+};
+
+const unsigned num_bench_usb_ids = sizeof(bench_usb_ids) / sizeof(bench_usb_ids[0]);
+
+static ata_identify_device bench_ids[num_bench_models];
+
+static ata_smart_values bench_smartval;
+static ata_smart_thresholds_pvt bench_smartthres;
+
+static void init_smart_values()
+{
+  static const unsigned char ids[] = {
+    1, 3, 4, 5, 7, 9, 10, 12, 183, 184, 187, 188, 189, 190, 191,
+    192, 193, 194, 195, 196, 197, 198, 199, 240, 241, 242
+  };
+  memset(&bench_smartval, 0, sizeof(bench_smartval));
+  memset(&bench_smartthres, 0, sizeof(bench_smartthres));
+  for (unsigned i = 0; i < sizeof(ids); i++) {
+    ata_smart_attribute & a = bench_smartval.vendor_attributes[i];
+    a.id = ids[i];
+    a.flags = 0x0033;
+    a.current = 100; a.worst = 90;
+    for (int j = 0; j < 6; j++)
+      a.raw[j] = (unsigned char)(ids[i] * (j + 1));
+    bench_smartthres.thres_entries[i].id = ids[i];
+    bench_smartthres.thres_entries[i].threshold = (i & 1 ? 10 : 0);
+  }
+}
+
+// Error counter log page (0x03) with parameters 0-6
+static unsigned char bench_errpage[4 + 7 * (4 + 8)];
+
+static void init_errpage()
+{
+  unsigned char * p = bench_errpage;
+  p[0] = 0x03;
+  p[3] = sizeof(bench_errpage) - 4;
+  p += 4;
+  for (int pc = 0; pc < 7; pc++, p += 4 + 8) {
+    p[1] = pc; p[2] = 0x02; p[3] = 8;
+    uint64_t val = 0x0123456789ULL * (pc + 1);
+    for (int i = 0; i < 8; i++)
+      p[4 + i] = (unsigned char)(val >> (8 * (7 - i)));
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+
+static volatile unsigned bench_sink; // Prevents elimination of results
+
+static void bench_lookup_drive(unsigned n)
+{
+  for (unsigned i = 0; i < n; i++) {
+    ata_vendor_attr_defs defs;
+    firmwarebug_defs firmwarebugs;
+    const drive_settings * dbentry = lookup_drive_apply_presets(
+      &bench_ids[i % num_bench_models], defs, firmwarebugs);
+    bench_sink += (dbentry != 0);
+  }
+}
+
+static void bench_lookup_usb_device(unsigned n)
+{
+  for (unsigned i = 0; i < n; i++) {
+    const int * id = bench_usb_ids[i % num_bench_usb_ids];
+    usb_dev_info info, info2;
+    bench_sink += lookup_usb_device(id[0], id[1], id[2], info, info2);
+  }
+}
+
+static void bench_format_id_string(unsigned n)
+{
+  for (unsigned i = 0; i < n; i++) {
+    const ata_identify_device & id = bench_ids[i % num_bench_models];
+    char model[40+1], serial[20+1], firmware[8+1];
+    ata_format_id_string(model, id.model, sizeof(model)-1);
+    ata_format_id_string(serial, id.serial_no, sizeof(serial)-1);
+    ata_format_id_string(firmware, id.fw_rev, sizeof(firmware)-1);
+    bench_sink += model[0] + serial[0] + firmware[0];
+  }
+}
+
+static void bench_get_size_info(unsigned n)
+{
+  for (unsigned i = 0; i < n; i++) {
+    ata_size_info sizes;
+    ata_get_size_info(&bench_ids[i % num_bench_models], sizes);
+    bench_sink += (unsigned)sizes.capacity;
+  }
+}
+
+// Attribute checks of a smartd cycle, plan is resolved once per device
+static void bench_attr_decode(unsigned n)
+{
+  ata_attr_plan plan;
+  plan.init(bench_smartval, bench_smartthres.thres_entries, get_default_attr_defs());
+  for (unsigned i = 0; i < n; i++) {
+    if (!plan.matches(bench_smartval))
+      plan.init(bench_smartval, bench_smartthres.thres_entries, get_default_attr_defs());
+    for (int j = 0; j < NUMBER_ATA_SMART_ATTRIBUTES; j++) {
+      const ata_smart_attribute & attr = bench_smartval.vendor_attributes[j];
+      if (!attr.id)
+        continue;
+      unsigned char threshold = 0;
+      ata_attr_state state = plan.get_state(attr, j, &threshold);
+      bench_sink += state + threshold + (unsigned)plan.get_raw_value(attr, j);
+    }
+  }
+}
+
+static void bench_decode_err_counter(unsigned n)
+{
+  for (unsigned i = 0; i < n; i++) {
+    scsiErrorCounter ec;
+    scsiDecodeErrCounterPage(bench_errpage, &ec);
+    bench_sink += (unsigned)ec.counter[6];
+  }
+}
+
+// Typical drive database pattern
+static const char bench_regex_pattern[] =
+  "WDC WD(7500BFC|10EALX|[12]0[0-9]{2}FYYS|[12]00[0-9]EFRX)-.*|"
+  "WDC WD[1-6]0EFRX-68(AX9N0|EZRN0|L0BN1|WT0N0)";
+
+static void bench_regex_full_match(unsigned n)
+{
+  static const regular_expression regex(bench_regex_pattern, REG_EXTENDED);
+  for (unsigned i = 0; i < n; i++)
+    bench_sink += regex.full_match(bench_models[i % num_bench_models][0]);
+}
+
+// Same as above with regexec(), for comparison
+static void bench_regexec_full_match(unsigned n)
+{
+  static regex_t regex;
+  static bool compiled = false;
+  if (!compiled) {
+    if (regcomp(&regex, bench_regex_pattern, REG_EXTENDED))
+      exit(EXIT_FAILURE);
+    compiled = true;
+  }
+  for (unsigned i = 0; i < n; i++) {
+    const char * str = bench_models[i % num_bench_models][0];
+    regmatch_t range;
+    bench_sink += (   !regexec(&regex, str, 1, &range, 0)
+                   && range.rm_so == 0 && range.rm_eo == (int)strlen(str));
+  }
+}
+
+static void bench_regex_compile(unsigned n)
+{
+  for (unsigned i = 0; i < n; i++) {
+    regular_expression regex(bench_regex_pattern, REG_EXTENDED);
+    bench_sink += !regex.empty();
+  }
+}
+
+static void bench_regex_copy(unsigned n)
+{
+  static const regular_expression regex(bench_regex_pattern, REG_EXTENDED);
+  for (unsigned i = 0; i < n; i++) {
+    regular_expression copy(regex);
+    bench_sink += !copy.empty();
+  }
+}
+
+static const char * drivedb_path = "drivedb.h";
+
+// Must be run last because each call appends to the drive database
+static void bench_parse_drive_database(unsigned n)
+{
+  for (unsigned i = 0; i < n; i++) {
+    if (!read_drive_database(drivedb_path))
+      exit(EXIT_FAILURE);
+  }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Benchmark runner
+
+struct bench_result
+{
+  std::string name;
+  double ns_per_op;
+  double allocs_per_op;
+};
+
+typedef void (* bench_func)(unsigned n);
+
+// Run F with doubled number of iterations until MIN_USEC is reached
+static bench_result run_bench(const char * name, bench_func f, int64_t min_usec,
+  unsigned max_n)
+{
+  f(1); // Warm up caches and static data
+  unsigned n = 1;
+  int64_t usec;
+  unsigned long allocs;
+  for (;;) {
+    unsigned long start_allocs = alloc_count;
+    int64_t start = smi()->get_timer_usec();
+    f(n);
+    usec = smi()->get_timer_usec() - start;
+    allocs = alloc_count - start_allocs;
+    if (usec >= min_usec || n >= max_n)
+      break;
+    n *= 2;
+  }
+
+  bench_result r;
+  r.name = name;
+  r.ns_per_op = usec * 1000.0 / n;
+  r.allocs_per_op = (double)allocs / n;
+  return r;
+}
+
+// Read baseline results, return false on error
+static bool read_baseline(const char * path, std::vector<bench_result> & results)
+{
+  stdio_file f(path, "r");
+  if (!f) {
+    pout("%s: %s\n", path, strerror(errno));
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#')
+      continue;
+    char name[64]; double ns, allocs;
+    if (sscanf(line, "%63s %lf %lf", name, &ns, &allocs) != 3) {
+      pout("%s: Syntax error: %s", path, line);
+      return false;
+    }
+    bench_result r;
+    r.name = name; r.ns_per_op = ns; r.allocs_per_op = allocs;
+    results.push_back(r);
+  }
+  return true;
+}
+
+static bool write_baseline(const char * path, const std::vector<bench_result> & results)
+{
+  stdio_file f(path, "w");
+  if (!f) {
+    pout("%s: %s\n", path, strerror(errno));
+    return false;
+  }
+  fprintf(f, "# NAME NS/OP ALLOCS/OP\n");
+  for (unsigned i = 0; i < results.size(); i++)
+    fprintf(f, "%s %.1f %.2f\n", results[i].name.c_str(),
+            results[i].ns_per_op, results[i].allocs_per_op);
+  return !ferror(f);
+}
+
+static void Usage()
+{
+  printf("Usage: smartbench [-B DRIVEDB] [-b BASELINE] [-s BASELINE] [-t MSEC] [-p PERCENT]\n\n"
+"  -B DRIVEDB   Drive database to parse and use for lookups [default is drivedb.h]\n"
+"  -b BASELINE  Compare results with BASELINE, exit(1) on regressions\n"
+"  -s BASELINE  Save results to BASELINE\n"
+"  -t MSEC      Minimum run time of each benchmark [default is 500]\n"
+"  -p PERCENT   Time increase reported as regression [default is 10]\n");
+}
+
+int main(int argc, char ** argv)
+{
+  const char * baseline_in = 0, * baseline_out = 0;
+  int min_msec = 500, tolerance = 10;
+
+  for (int i = 1; i < argc; i++) {
+    const char * arg = (i + 1 < argc ? argv[i + 1] : 0);
+    if (!strcmp(argv[i], "-B") && arg)
+      drivedb_path = arg;
+    else if (!strcmp(argv[i], "-b") && arg)
+      baseline_in = arg;
+    else if (!strcmp(argv[i], "-s") && arg)
+      baseline_out = arg;
+    else if (!strcmp(argv[i], "-t") && arg && (min_msec = atoi(arg)) > 0)
+      ;
+    else if (!strcmp(argv[i], "-p") && arg && (tolerance = atoi(arg)) > 0)
+      ;
+    else {
+      Usage();
+      return (!strcmp(argv[i], "-h") ? 0 : EXIT_FAILURE);
+    }
+    i++;
+  }
+
+  try {
+    smart_interface::init();
+
+    std::vector<bench_result> baseline;
+    if (baseline_in && !read_baseline(baseline_in, baseline))
+      return EXIT_FAILURE;
+
+    if (!(read_drive_database(drivedb_path) && init_drive_database(false)))
+      return EXIT_FAILURE;
+    for (unsigned i = 0; i < num_bench_models; i++)
+      init_identify(bench_ids[i], bench_models[i][0], bench_models[i][1]);
+    init_smart_values();
+    init_errpage();
+
+    static const struct {
+      const char * name;
+      bench_func func;
+      unsigned max_n;
+    } benches[] = {
+      { "lookup_drive",          bench_lookup_drive,         ~0U },
+      { "lookup_usb_device",     bench_lookup_usb_device,    ~0U },
+      { "ata_format_id_string",  bench_format_id_string,     ~0U },
+      { "ata_get_size_info",     bench_get_size_info,        ~0U },
+      { "smart_attr_decode",     bench_attr_decode,          ~0U },
+      { "scsiDecodeErrCounter",  bench_decode_err_counter,   ~0U },
+      { "regex_full_match",      bench_regex_full_match,     ~0U },
+      { "regexec_full_match",    bench_regexec_full_match,   ~0U },
+      { "regex_compile",         bench_regex_compile,        ~0U },
+      { "regex_copy",            bench_regex_copy,           ~0U },
+      { "parse_drive_database",  bench_parse_drive_database, 64  } // last
+    };
+
+    std::vector<bench_result> results;
+    int regressions = 0;
+    printf("%-24s %12s %12s %s\n", "NAME", "NS/OP", "ALLOCS/OP",
+           (baseline_in ? "  BASELINE" : ""));
+    for (unsigned i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+      bench_result r = run_bench(benches[i].name, benches[i].func,
+                                 min_msec * 1000LL, benches[i].max_n);
+      results.push_back(r);
+      printf("%-24s %12.1f %12.2f", r.name.c_str(), r.ns_per_op, r.allocs_per_op);
+
+      for (unsigned j = 0; j < baseline.size(); j++) {
+        const bench_result & b = baseline[j];
+        if (b.name != r.name)
+          continue;
+        bool slower = (r.ns_per_op > b.ns_per_op * (100 + tolerance) / 100);
+        bool more_allocs = (r.allocs_per_op > b.allocs_per_op + 0.005);
+        printf("  %+6.1f%%%s%s", (b.ns_per_op > 0 ?
+               (r.ns_per_op - b.ns_per_op) * 100 / b.ns_per_op : 0.0),
+               (slower ? " SLOWER" : ""), (more_allocs ? " MORE ALLOCS" : ""));
+        if (slower || more_allocs)
+          regressions++;
+        break;
+      }
+      printf("\n");
+      fflush(stdout);
+    }
+
+    if (baseline_out && !write_baseline(baseline_out, results))
+      return EXIT_FAILURE;
+    if (regressions) {
+      printf("%d regression(s) found\n", regressions);
+      return 1;
+    }
+  }
+  catch (const std::exception & ex) {
+    pout("smartbench: Exception: %s\n", ex.what());
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
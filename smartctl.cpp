@@ -44,6 +44,7 @@
 #include "int64.h"
 #include "atacmds.h"
 #include "dev_interface.h"
+#include "dev_sim.h"
 #include "ataprint.h"
 #include "knowndrives.h"
 #include "scsicmds.h"
@@ -109,6 +110,10 @@ static void Usage()
 "         Set action on bad checksum to one of: warn, exit, ignore\n\n"
 "  -r TYPE, --report=TYPE\n"
 "         Report transactions (see man page)\n\n"
+"  --record=FILE\n"
+"         Record device responses to FILE for replay with '-d sim'\n\n"
+"  --typecache=FILE\n"
+"         Cache results of device type autodetection in FILE\n\n"
 "  -n MODE, --nocheck=MODE                                             (ATA)\n"
 "         No check if: never, sleep, standby, idle (see man page)\n\n",
   getvalidarglist('d').c_str()); // TODO: Use this function also for other options ?
@@ -138,11 +143,12 @@ static void Usage()
 "  -l TYPE, --log=TYPE\n"
 "        Show device log. TYPE: error, selftest, selective, directory[,g|s],\n"
 "                               xerror[,N][,error], xselftest[,N][,selftest],\n"
-"                               background, sasphy[,reset], sataphy[,reset],\n"
+"                               background, defects[,p|g],\n"
+"                               sasphy[,reset], sataphy[,reset],\n"
 "                               scttemp[sts,hist], scttempint,N[,p],\n"
 "                               scterc[,N,M], devstat[,N], ssd,\n"
 "                               gplog,N[,RANGE], smartlog,N[,RANGE],\n"
-"                               nvmelog,N,SIZE\n\n"
+"                               nvmelog,N,SIZE, nvmetelemetry[,N]\n\n"
 "  -v N,OPTION , --vendorattribute=N,OPTION                            (ATA)\n"
 "        Set display OPTION for vendor Attribute N (see man page)\n\n"
 "  -F TYPE, --firmwarebug=TYPE                                         (ATA)\n"
@@ -180,7 +186,8 @@ static void Usage()
 }
 
 // Values for  --long only options, see parse_options()
-enum { opt_identify = 1000, opt_scan, opt_scan_open, opt_set, opt_smart };
+enum { opt_identify = 1000, opt_scan, opt_scan_open, opt_set, opt_smart, opt_record,
+       opt_typecache };
 
 /* Returns a string containing a formatted list of the valid arguments
    to the option opt or empty on failure. Note 'v' case different */
@@ -204,11 +211,11 @@ static std::string getvalidarglist(int opt)
   case 'l':
     return "error, selftest, selective, directory[,g|s], "
            "xerror[,N][,error], xselftest[,N][,selftest], "
-           "background, sasphy[,reset], sataphy[,reset], "
+           "background, defects[,p|g], sasphy[,reset], sataphy[,reset], "
            "scttemp[sts,hist], scttempint,N[,p], "
            "scterc[,N,M], devstat[,N], ssd, "
            "gplog,N[,RANGE], smartlog,N[,RANGE], "
-           "nvmelog,N,SIZE";
+           "nvmelog,N,SIZE, nvmetelemetry[,N]";
   case 'P':
     return "use, ignore, show, showall";
   case 't':
@@ -261,6 +268,12 @@ enum checksum_err_mode_t {
 
 static checksum_err_mode_t checksum_err_mode = CHECKSUM_ERR_WARN;
 
+// Response file set by '--record=FILE'
+static const char * record_file = 0;
+
+// Type cache file set by '--typecache=FILE'
+static const char * typecache_file = 0;
+
 static void scan_devices(const smart_devtype_list & types, bool with_open, char ** argv);
 
 
@@ -307,6 +320,8 @@ static const char * parse_options(int argc, char** argv,
     { "set",             required_argument, 0, opt_set },
     { "scan",            no_argument,       0, opt_scan      },
     { "scan-open",       no_argument,       0, opt_scan_open },
+    { "record",          required_argument, 0, opt_record },
+    { "typecache",       required_argument, 0, opt_typecache },
     { 0,                 0,                 0, 0   }
   };
 
@@ -383,6 +398,12 @@ static const char * parse_options(int argc, char** argv,
         badarg = true;
       }
       break;
+    case opt_record:
+      record_file = optarg;
+      break;
+    case opt_typecache:
+      typecache_file = optarg;
+      break;
     case 'r':
       {
         int n1 = -1, n2 = -1, len = strlen(optarg);
@@ -489,6 +510,12 @@ static const char * parse_options(int argc, char** argv,
         ataopts.sataphy = ataopts.sataphy_reset = true;
       } else if (!strcmp(optarg,"background")) {
         scsiopts.smart_background_log = true;
+      } else if (!strcmp(optarg,"defects")) {
+        scsiopts.defect_plist = scsiopts.defect_glist = true;
+      } else if (!strcmp(optarg,"defects,p")) {
+        scsiopts.defect_plist = true;
+      } else if (!strcmp(optarg,"defects,g")) {
+        scsiopts.defect_glist = true;
       } else if (!strcmp(optarg,"ssd")) {
         ataopts.devstat_ssd_page = true;
         scsiopts.smart_ss_media_log = true;
@@ -603,13 +630,25 @@ static const char * parse_options(int argc, char** argv,
         int n = -1, len = strlen(optarg);
         unsigned page = 0, size = 0;
         sscanf(optarg, "nvmelog,0x%x,0x%x%n", &page, &size, &n);
-        if (n == len && page <= 0xff && 0 < size && size <= 0x4000) {
+        if (n == len && page <= 0xff && 0 < size && size <= 0x40000000) {
           nvmeopts.log_page = page; nvmeopts.log_page_size = size;
         }
         else
           badarg = true;
       }
 
+      else if (str_starts_with(optarg, "nvmetelemetry")) {
+        int n1 = -1, n2 = -1, len = strlen(optarg);
+        unsigned area = 0;
+        sscanf(optarg, "nvmetelemetry%n,%u%n", &n1, &area, &n2);
+        if (n1 == len)
+          nvmeopts.telemetry_area = 1;
+        else if (n2 == len && 1 <= area && area <= 3)
+          nvmeopts.telemetry_area = area;
+        else
+          badarg = true;
+      }
+
       else {
         badarg = true;
       }
@@ -1029,9 +1068,8 @@ static const char * parse_options(int argc, char** argv,
 
   // Special handling of --scan, --scanopen
   if (scan) {
-    // Read or init drive database to allow USB ID check.
-    if (!init_drive_database(use_default_db))
-      EXIT(FAILCMD);
+    // Read or init drive database on demand to allow USB ID check.
+    init_drive_database_lazy(use_default_db, FAILCMD);
     scan_devices(scan_types, (scan == opt_scan_open), argv + optind);
     EXIT(0);
   }
@@ -1116,9 +1154,8 @@ static const char * parse_options(int argc, char** argv,
     EXIT(FAILCMD);
   }
 
-  // Read or init drive database
-  if (!init_drive_database(use_default_db))
-    EXIT(FAILCMD);
+  // Read or init drive database on first use
+  init_drive_database_lazy(use_default_db, FAILCMD);
 
   return type;
 }
@@ -1275,6 +1312,9 @@ static int main_worker(int argc, char **argv)
 
   const char * name = argv[argc-1];
 
+  if (typecache_file)
+    smi()->set_type_cache_file(typecache_file);
+
   smart_device_auto_ptr dev;
   if (!strcmp(name,"-")) {
     // Parse "smartctl -r ataioctl,2 ..." output from stdin
@@ -1322,12 +1362,27 @@ static int main_worker(int argc, char **argv)
         && oldinfo.dev_type != dev->get_dev_type()                               )
       pout("%s: Device open changed type from '%s' to '%s'\n",
         dev->get_info_name(), oldinfo.dev_type.c_str(), dev->get_dev_type());
+
+    // Save result of autodetection for '--typecache'
+    if (!type && !smi()->update_type_cache(dev.get()))
+      pout("%s: Unable to write type cache file \"%s\": %s\n", dev->get_info_name(),
+           typecache_file, strerror(errno));
   }
   if (!dev->is_open()) {
     pout("Smartctl open device: %s failed: %s\n", dev->get_info_name(), dev->get_errmsg());
     return FAILDEV;
   }
 
+  // Record responses for '-d sim'
+  if (record_file && !print_type_only) {
+    smart_device * recdev = get_sim_recorder(smi(), dev.get(), record_file);
+    if (!recdev) {
+      pout("%s: Unable to record responses: %s\n", dev->get_info_name(), smi()->get_errmsg());
+      return FAILCMD;
+    }
+    dev.replace(recdev);
+  }
+
   // now call appropriate ATA or SCSI routine
   int retval = 0;
   if (print_type_only)
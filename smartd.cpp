@@ -43,6 +43,7 @@
 #include <string>
 #include <vector>
 #include <algorithm> // std::replace()
+#include <map>
 
 // conditionally included files
 #ifndef _WIN32
@@ -70,9 +71,16 @@ typedef int pid_t;
 #include <cap-ng.h>
 #endif // LIBCAP_NG
 
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <linux/netlink.h> // NETLINK_KOBJECT_UEVENT
+#endif // __linux__
+
 // locally included files
 #include "atacmds.h"
 #include "dev_interface.h"
+#include "dev_sim.h"
 #include "knowndrives.h"
 #include "scsicmds.h"
 #include "nvmecmds.h"
@@ -129,6 +137,12 @@ static unsigned char debugmode = 0;
 #define CHECKTIME 1800
 static int checktime=CHECKTIME;
 
+// max time between full checks if SMART data is unchanged
+#define FULLCHECKTIME 3600
+
+// command-line: max time to keep devices open between checks, 0 to close always
+static int keepopen_time = 0;
+
 // command-line: name of PID file (empty for no pid file)
 static std::string pid_file;
 
@@ -146,6 +160,9 @@ static std::string attrlog_path_prefix
 #endif
                                     ;
 
+// command-line: path prefix of response files recorded for '-d sim', empty if none.
+static std::string record_path_prefix;
+
 // configuration file name
 static const char * configfile;
 // configuration file "name" if read from stdin
@@ -159,6 +176,9 @@ static std::string warning_script;
 // command-line: when should we exit?
 static int quit=0;
 
+// command-line: '-q showtiming' prints duration of check phases
+static bool show_timing = false;
+
 // command-line; this is the default syslog(3) log facility to use.
 static int facility=LOG_DAEMON;
 
@@ -235,6 +255,7 @@ struct dev_config
   std::string dev_name;                   // Device name (plain, for SMARTD_DEVICE variable)
   std::string dev_type;                   // Device type argument from -d directive, empty if none
   std::string dev_idinfo;                 // Device identify info for warning emails
+  std::string nvme_ctrl_id;               // NVMe controller identity, empty if not NVMe
   std::string state_file;                 // Path of the persistent state file, empty if none
   std::string attrlog_file;               // Path of the persistent attrlog file, empty if none
   bool ignore;                            // Ignore this entry
@@ -281,12 +302,23 @@ struct dev_config
   bool sct_erc_set;                       // set SCT ERC to:
   unsigned short sct_erc_readtime;        // ERC read time (deciseconds)
   unsigned short sct_erc_writetime;       // ERC write time (deciseconds)
+  unsigned short scttemp_interval;        // Read SCT temperature history every N minutes, 0 if not
+  unsigned scan_chunks;                   // Surface scan in N selective self-test chunks, 0 if not
+  std::string scan_group;                 // Surface scan group (enclosure), empty if none
+  unsigned scan_group_max;                // Max number of devices of group scanning concurrently
 
   unsigned char curr_pending_id;          // ID of current pending sector count, 0 if none
   unsigned char offl_pending_id;          // ID of offline uncorrectable sector count, 0 if none
   bool curr_pending_incr, offl_pending_incr; // True if current/offline pending values increase
   bool curr_pending_set,  offl_pending_set;  // True if '-C', '-U' set in smartd.conf
 
+  // SCSI ONLY
+  bool backgroundlog;                     // Monitor new background scan results
+  unsigned sasphy_warn;                   // Track SAS phy error counters, warn if increased
+                                          // by >= this per check, 0 if not tracked
+  unsigned grown_defects_warn;            // Track grown defect list, warn if increased
+                                          // by >= this per check, 0 if not tracked
+
   attribute_flags monitor_attr_flags;     // MONITOR_* flags for each attribute
 
   ata_vendor_attr_defs attribute_defs;    // -v options
@@ -327,15 +359,21 @@ dev_config::dev_config()
   set_wcache(0),
   sct_erc_set(false),
   sct_erc_readtime(0), sct_erc_writetime(0),
+  scttemp_interval(0),
+  scan_chunks(0),
+  scan_group_max(1),
   curr_pending_id(0), offl_pending_id(0),
   curr_pending_incr(false), offl_pending_incr(false),
-  curr_pending_set(false),  offl_pending_set(false)
+  curr_pending_set(false),  offl_pending_set(false),
+  backgroundlog(false),
+  sasphy_warn(0),
+  grown_defects_warn(0)
 {
 }
 
 
 // Number of allowed mail message types
-static const int SMARTD_NMAIL = 13;
+static const int SMARTD_NMAIL = 16;
 // Type for '-M test' mails (state not persistent)
 static const int MAILTYPE_TEST = 0;
 // TODO: Add const or enum for all mail types.
@@ -362,6 +400,10 @@ struct persistent_dev_state
   uint64_t selective_test_last_start;     // Start LBA of last scheduled selective self-test
   uint64_t selective_test_last_end;       // End LBA of last scheduled selective self-test
 
+  unsigned scan_chunk;                    // Surface scan chunk in progress or next to start
+  bool scan_running;                      // Surface scan chunk in progress
+  time_t scan_pass_start;                 // Time of first chunk of current surface scan pass
+
   mailinfo maillog[SMARTD_NMAIL];         // log info on when mail sent
 
   // ATA ONLY
@@ -397,6 +439,13 @@ struct persistent_dev_state
   };
   scsi_nonmedium_error_t scsi_nonmedium_error;
 
+  uint64_t scsi_grown_defects;            // Number of elements in grown defect list
+  unsigned scsi_selftest_last_key;        // Newest self-test log entry processed
+  int scsi_selftest_last_count;           // Number of entries with this key
+  uint64_t scsi_bms_last_key;             // Newest background scan result processed
+  unsigned char scsi_log_keys_valid;      // Values above are valid: 1=self-test, 2=background scan,
+                                          // 4=grown defects
+
   // NVMe only
   uint64_t nvme_err_log_entries;
 
@@ -410,11 +459,95 @@ persistent_dev_state::persistent_dev_state()
   scheduled_test_next_check(0),
   selective_test_last_start(0),
   selective_test_last_end(0),
+  scan_chunk(0),
+  scan_running(false),
+  scan_pass_start(0),
   ataerrorcount(0),
+  scsi_grown_defects(0),
+  scsi_selftest_last_key(0),
+  scsi_selftest_last_count(0),
+  scsi_bms_last_key(0),
+  scsi_log_keys_valid(0),
   nvme_err_log_entries(0)
 {
 }
 
+// Phases of a device check
+enum check_phase {
+  PHASE_OPEN, PHASE_POWERMODE, PHASE_SMART, PHASE_LOGS, PHASE_SELFTEST,
+  PHASE_MAIL, PHASE_CLOSE, NUM_PHASES
+};
+
+static const char * const check_phase_names[NUM_PHASES] = {
+  "open", "powermode", "smart", "logs", "selftest", "mail", "close"
+};
+
+// Warn if one phase of a device check takes longer
+#define SLOW_PHASE_USEC (30 * 1000000LL)
+
+// Duration of the phases of the last device check
+struct check_timing
+{
+  int64_t usec[NUM_PHASES];               // Duration of each phase
+  int phase;                              // Current phase, -1 if check not running
+  int64_t start;                          // Start time of current phase
+  int slow_phase;                         // Phase reported as slow, -1 if none
+
+  check_timing();
+
+  // Start timing of a device check
+  void begin();
+  // Switch to phase P, return previous phase
+  int set_phase(int p);
+  // Stop timing of device check
+  void end();
+};
+
+check_timing::check_timing()
+: phase(-1), start(0), slow_phase(-1)
+{
+  memset(usec, 0, sizeof(usec));
+}
+
+void check_timing::begin()
+{
+  memset(usec, 0, sizeof(usec));
+  phase = PHASE_OPEN;
+  start = smi()->get_timer_usec();
+}
+
+int check_timing::set_phase(int p)
+{
+  int prev = phase;
+  if (prev < 0)
+    return prev;
+  int64_t now = smi()->get_timer_usec();
+  usec[prev] += now - start;
+  start = now;
+  phase = p;
+  return prev;
+}
+
+void check_timing::end()
+{
+  set_phase(-1);
+}
+
+// Switch to another phase for the lifetime of the object
+class scoped_check_phase
+{
+public:
+  scoped_check_phase(check_timing & timing, int phase)
+    : m_timing(timing), m_prev(timing.set_phase(phase)) { }
+
+  ~scoped_check_phase()
+    { m_timing.set_phase(m_prev); }
+
+private:
+  check_timing & m_timing;
+  int m_prev;
+};
+
 /// Non-persistent state data for a device.
 struct temp_dev_state
 {
@@ -433,6 +566,12 @@ struct temp_dev_state
   int powerskipcnt;                       // Number of checks skipped due to idle or standby mode
   int lastpowermodeskipped;               // the last power mode that was skipped
 
+  time_t open_time;                       // Time when device was opened for checks
+
+  uint64_t data_digest;                   // Digest of SMART data (ATA) or IE info (SCSI)
+  time_t full_check_time;                 // Time of last check with new digest
+  time_t log_check_time;                  // Time of last unconditional log read
+
   // SCSI ONLY
   unsigned char SmartPageSupported;       // has log sense IE page (0x2f)
   unsigned char TempPageSupported;        // has log sense temperature page (0xd)
@@ -443,12 +582,21 @@ struct temp_dev_state
   unsigned char SuppressReport;           // minimize nuisance reports
   unsigned char modese_len;               // mode sense/select cmd len: 0 (don't
                                           // know yet) 6 or 10
+  uint64_t scsi_ecounter_digest[4];       // Digests of error counter log pages
+  std::vector<scsiSasPhyCounters> sas_phys; // SAS phy error counters of last check
+  time_t sas_phys_time;                   // Time of last check of SAS phy error counters
   // ATA ONLY
   uint64_t num_sectors;                   // Number of sectors
   ata_smart_values smartval;              // SMART data
   ata_smart_thresholds_pvt smartthres;    // SMART thresholds
+  ata_attr_plan attrplan;                 // Resolved thresholds and attribute defs
   bool offline_started;                   // true if offline data collection was started
   bool selftest_started;                  // true if self-test was started
+  int last_errcnt, last_xerrcnt;          // Error counts from last read of each log, -1 if unknown
+  int scttemp_index;                      // Last index of SCT temperature history, -1 if unknown
+  time_t scttemp_time;                    // Time of last read of SCT temperature history
+
+  check_timing timing;                    // Duration of check phases
 
   temp_dev_state();
 };
@@ -465,6 +613,10 @@ temp_dev_state::temp_dev_state()
   powermodefail(false),
   powerskipcnt(0),
   lastpowermodeskipped(0),
+  open_time(0),
+  data_digest(0),
+  full_check_time(0),
+  log_check_time(0),
   SmartPageSupported(false),
   TempPageSupported(false),
   ReadECounterPageSupported(false),
@@ -473,10 +625,15 @@ temp_dev_state::temp_dev_state()
   NonMediumErrorPageSupported(false),
   SuppressReport(false),
   modese_len(0),
+  sas_phys_time(0),
   num_sectors(0),
   offline_started(false),
-  selftest_started(false)
+  selftest_started(false),
+  last_errcnt(-1), last_xerrcnt(-1),
+  scttemp_index(-1),
+  scttemp_time(0)
 {
+  memset(scsi_ecounter_digest, 0, sizeof(scsi_ecounter_digest));
   memset(&smartval, 0, sizeof(smartval));
   memset(&smartthres, 0, sizeof(smartthres));
 }
@@ -571,12 +728,20 @@ static bool parse_dev_state_line(const char * line, persistent_dev_state & state
        ")" // 18)
       ")" // 16)
      "|(nvme-err-log-entries)" // (24)
+     "|(scsi-grown-defects)" // (25)
+     "|(scsi-self-test-last-key)" // (26)
+     "|(scsi-self-test-last-count)" // (27)
+     "|(scsi-bms-last-key)" // (28)
+     "|(scsi-log-keys-valid)" // (29)
+     "|(surface-scan-chunk)" // (30)
+     "|(surface-scan-running)" // (31)
+     "|(surface-scan-pass-start)" // (32)
      ")" // 1)
-     " *= *([0-9]+)[ \n]*$", // (25)
+     " *= *([0-9]+)[ \n]*$", // (33)
     REG_EXTENDED
   );
 
-  const int nmatch = 1+25;
+  const int nmatch = 1+33;
   regmatch_t match[nmatch];
   if (!regex.execute(line, nmatch, match))
     return false;
@@ -636,6 +801,28 @@ static bool parse_dev_state_line(const char * line, persistent_dev_state & state
   }
   else if (match[m+7].rm_so >= 0)
     state.nvme_err_log_entries = val;
+  else if (match[m+8].rm_so >= 0) {
+    state.scsi_grown_defects = val;
+    state.scsi_log_keys_valid |= 0x04;
+  }
+  else if (match[m+9].rm_so >= 0) {
+    state.scsi_selftest_last_key = (unsigned)val;
+    state.scsi_log_keys_valid |= 0x01;
+  }
+  else if (match[m+10].rm_so >= 0)
+    state.scsi_selftest_last_count = (int)val;
+  else if (match[m+11].rm_so >= 0) {
+    state.scsi_bms_last_key = val;
+    state.scsi_log_keys_valid |= 0x02;
+  }
+  else if (match[m+12].rm_so >= 0)
+    state.scsi_log_keys_valid |= (unsigned char)val;
+  else if (match[m+13].rm_so >= 0)
+    state.scan_chunk = (unsigned)val;
+  else if (match[m+14].rm_so >= 0)
+    state.scan_running = !!val;
+  else if (match[m+15].rm_so >= 0)
+    state.scan_pass_start = (time_t)val;
   else
     return false;
   return true;
@@ -714,6 +901,9 @@ static bool write_dev_state(const char * path, const persistent_dev_state & stat
   write_dev_state_line(f, "scheduled-test-next-check", state.scheduled_test_next_check);
   write_dev_state_line(f, "selective-test-last-start", state.selective_test_last_start);
   write_dev_state_line(f, "selective-test-last-end", state.selective_test_last_end);
+  write_dev_state_line(f, "surface-scan-chunk", state.scan_chunk);
+  write_dev_state_line(f, "surface-scan-running", state.scan_running);
+  write_dev_state_line(f, "surface-scan-pass-start", state.scan_pass_start);
 
   int i;
   for (i = 0; i < SMARTD_NMAIL; i++) {
@@ -741,6 +931,13 @@ static bool write_dev_state(const char * path, const persistent_dev_state & stat
     write_dev_state_line(f, "ata-smart-attribute", i, "resvd", pa.resvd);
   }
 
+  // SCSI ONLY
+  write_dev_state_line(f, "scsi-grown-defects", state.scsi_grown_defects);
+  write_dev_state_line(f, "scsi-self-test-last-key", state.scsi_selftest_last_key);
+  write_dev_state_line(f, "scsi-self-test-last-count", state.scsi_selftest_last_count);
+  write_dev_state_line(f, "scsi-bms-last-key", state.scsi_bms_last_key);
+  write_dev_state_line(f, "scsi-log-keys-valid", state.scsi_log_keys_valid);
+
   // NVMe only
   write_dev_state_line(f, "nvme-err-log-entries", state.nvme_err_log_entries);
 
@@ -961,13 +1158,19 @@ static void MailWarning(const dev_config & cfg, dev_state & state, int which, co
     "FailedOpenDevice",           // 9
     "CurrentPendingSector",       // 10
     "OfflineUncorrectableSector", // 11
-    "Temperature"                 // 12
+    "Temperature",                // 12
+    "GrownDefects",               // 13
+    "MediumScanError",            // 14
+    "SasPhyErrors"                // 15
   };
   
   // See if user wants us to send mail
   if (cfg.emailaddress.empty() && cfg.emailcmdline.empty())
     return;
 
+  // Account time spent for mail to its own phase
+  scoped_check_phase mail_phase(state.timing, PHASE_MAIL);
+
   std::string address = cfg.emailaddress;
   const char * executable = cfg.emailcmdline.c_str();
 
@@ -1428,8 +1631,10 @@ static void Directives()
            "  -n MODE No check if: never, sleep[,N][,q], standby[,N][,q], idle[,N][,q]\n"
            "  -H      Monitor SMART Health Status, report if failed\n"
            "  -s REG  Do Self-Test at time(s) given by regular expression REG\n"
+           "  -b N[,GROUP[,MAX]] Surface scan in N chunks, at most MAX devices of GROUP at once\n"
            "  -l TYPE Monitor SMART log or self-test status:\n"
-           "          error, selftest, xerror, offlinests[,ns], selfteststs[,ns]\n"
+           "          error, selftest, xerror, offlinests[,ns], selfteststs[,ns],\n"
+           "          background, sasphy[,N], scttemp[,N]\n"
            "  -l scterc,R,W  Set SCT Error Recovery Control\n"
            "  -e      Change device setting: aam,[N|off], apm,[N|off], lookahead,[on|off],\n"
            "          security-freeze, standby,[N|off], wcache,[on|off]\n"
@@ -1445,6 +1650,7 @@ static void Directives()
            "  -I ID   Ignore Attribute ID for -p, -u or -t Directive\n"
            "  -C ID[+] Monitor [increases of] Current Pending Sectors in Attribute ID\n"
            "  -U ID[+] Monitor [increases of] Offline Uncorrectable Sectors in Attribute ID\n"
+           "  -G N    Track Grown Defect List (SCSI), warn if increased by N per check\n"
            "  -W D,I,C Monitor Temperature D)ifference, I)nformal limit, C)ritical limit\n"
            "  -v N,ST Modifies labeling of Attribute N (see man page)  \n"
            "  -P TYPE Drive-specific presets: use, ignore, show, showall\n"
@@ -1468,20 +1674,23 @@ static const char *GetValidArgList(char opt)
   switch (opt) {
   case 'A':
   case 's':
+  case 'R':
     return "<PATH_PREFIX>";
   case 'c':
     return "<FILE_NAME>, -";
   case 'l':
     return "daemon, local0, local1, local2, local3, local4, local5, local6, local7";
   case 'q':
-    return "nodev, errors, nodevstartup, never, onecheck, showtests";
+    return "nodev, errors, nodevstartup, never, onecheck, showtests, showtiming";
   case 'r':
     return "ioctl[,N], ataioctl[,N], scsiioctl[,N], nvmeioctl[,N]";
   case 'B':
   case 'p':
+  case 't':
   case 'w':
     return "<FILE_NAME>";
   case 'i':
+  case 'k':
     return "<INTEGER_SECONDS>";
   default:
     return NULL;
@@ -1522,6 +1731,8 @@ static void Usage()
   PrintOut(LOG_INFO,"        Display this help and exit\n\n");
   PrintOut(LOG_INFO,"  -i N, --interval=N\n");
   PrintOut(LOG_INFO,"        Set interval between disk checks to N seconds, where N >= 10\n\n");
+  PrintOut(LOG_INFO,"  -k N, --keepopen=N\n");
+  PrintOut(LOG_INFO,"        Keep devices open between checks for up to N seconds [default is 0]\n\n");
   PrintOut(LOG_INFO,"  -l local[0-7], --logfacility=local[0-7]\n");
 #ifndef _WIN32
   PrintOut(LOG_INFO,"        Use syslog facility local0 - local7 or daemon [default]\n\n");
@@ -1538,12 +1749,16 @@ static void Usage()
   PrintOut(LOG_INFO,"        Quit on one of: %s\n\n", GetValidArgList('q'));
   PrintOut(LOG_INFO,"  -r, --report=TYPE\n");
   PrintOut(LOG_INFO,"        Report transactions for one of: %s\n\n", GetValidArgList('r'));
+  PrintOut(LOG_INFO,"  -R PREFIX, --record=PREFIX\n");
+  PrintOut(LOG_INFO,"        Record device responses to {PREFIX}NAME.sim for '-d sim'\n\n");
   PrintOut(LOG_INFO,"  -s PREFIX, --savestates=PREFIX\n");
   PrintOut(LOG_INFO,"        Save disk states to {PREFIX}MODEL-SERIAL.TYPE.state\n");
 #ifdef SMARTMONTOOLS_SAVESTATES
   PrintOut(LOG_INFO,"        [default is " SMARTMONTOOLS_SAVESTATES "MODEL-SERIAL.TYPE.state]\n");
 #endif
   PrintOut(LOG_INFO,"\n");
+  PrintOut(LOG_INFO,"  -t FILE, --typecache=FILE\n");
+  PrintOut(LOG_INFO,"        Cache results of device type autodetection in FILE\n\n");
   PrintOut(LOG_INFO,"  -w NAME, --warnexec=NAME\n");
   PrintOut(LOG_INFO,"        Run executable NAME on warnings\n");
 #ifndef _WIN32
@@ -1572,6 +1787,38 @@ static int CloseDevice(smart_device * device, const char * name)
   return 0;
 }
 
+// Open device for the next check.  If '-k N' is specified, a device
+// which is still open from a previous check is reused.
+static bool OpenDevice(dev_state & state, smart_device * device)
+{
+  state.timing.set_phase(PHASE_OPEN);
+  if (!(keepopen_time && device->is_open())) {
+    if (!device->open())
+      return false;
+    state.open_time = time(0);
+  }
+  // Errors are checked in CloseDeviceAfterCheck()
+  device->clear_err();
+  return true;
+}
+
+// Close device after check.  If '-k N' is specified, the device is kept
+// open unless an error occurred or the device is open for N seconds.
+static int CloseDeviceAfterCheck(dev_state & state, smart_device * device, const char * name)
+{
+  state.timing.set_phase(PHASE_CLOSE);
+  if (keepopen_time) {
+    time_t now = time(0);
+    if (   !device->get_errno()
+        && state.open_time <= now && now < state.open_time + keepopen_time)
+      return 0;
+    if (debugmode)
+      PrintOut(LOG_INFO, "Device: %s, closing device %s\n", name,
+               (device->get_errno() ? "after error" : "after max open time"));
+  }
+  return CloseDevice(device, name);
+}
+
 // return true if a char is not allowed in a state file name
 static bool not_allowed_in_filename(char c)
 {
@@ -1748,6 +1995,18 @@ static void format_set_result_msg(std::string & msg, const char * name, bool ok,
 // TODO: Add '-F swapid' directive
 const bool fix_swapped_id = false;
 
+// Read SCT Temperature History table, return false on error
+static bool read_sct_temp_history(ata_device * atadev, ata_sct_temperature_history_table & tmh)
+{
+  ata_sct_status_response sts;
+  if (ataReadSCTStatus(atadev, &sts) || ataReadSCTTempHist(atadev, &tmh, &sts))
+    return false;
+  // Check for valid circular buffer
+  if (!(1 <= tmh.cb_size && tmh.cb_size <= sizeof(tmh.cb) && tmh.cb_index < tmh.cb_size))
+    return false;
+  return true;
+}
+
 // scan to see what ata devices there are, and if they support SMART
 static int ATADeviceScan(dev_config & cfg, dev_state & state, ata_device * atadev)
 {
@@ -1919,6 +2178,8 @@ static int ATADeviceScan(dev_config & cfg, dev_state & state, ata_device * atade
         // Let ata_get_attr_state() return ATTRSTATE_NO_THRESHOLD:
         memset(&state.smartthres, 0, sizeof(state.smartthres));
       }
+      state.attrplan.init(state.smartval, state.smartthres.thres_entries,
+                          cfg.attribute_defs);
     }
 
     // see if the necessary Attribute is there to monitor offline or
@@ -1999,7 +2260,7 @@ static int ATADeviceScan(dev_config & cfg, dev_state & state, ata_device * atade
   if (cfg.selftest) {
     int retval;
     if (!(   cfg.permissive
-          || ( smart_logdir_ok && smart_logdir.entry[0x06-1].numsectors)
+          || ( smart_logdir_ok && ataGetNumLogSectors(&smart_logdir, 0x06, false))
           || (!smart_logdir_ok && smart_val_ok && isSmartTestLogCapable(&state.smartval, &drive)))) {
       PrintOut(LOG_INFO, "Device: %s, no SMART Self-test Log, ignoring -l selftest (override with -T permissive)\n", name);
       cfg.selftest = false;
@@ -2019,7 +2280,7 @@ static int ATADeviceScan(dev_config & cfg, dev_state & state, ata_device * atade
   if (cfg.errorlog) {
     int errcnt1;
     if (!(   cfg.permissive
-          || ( smart_logdir_ok && smart_logdir.entry[0x01-1].numsectors)
+          || ( smart_logdir_ok && ataGetNumLogSectors(&smart_logdir, 0x01, false))
           || (!smart_logdir_ok && smart_val_ok && isSmartErrorLogCapable(&state.smartval, &drive)))) {
       PrintOut(LOG_INFO, "Device: %s, no SMART Error Log, ignoring -l error (override with -T permissive)\n", name);
       cfg.errorlog = false;
@@ -2029,13 +2290,13 @@ static int ATADeviceScan(dev_config & cfg, dev_state & state, ata_device * atade
       cfg.errorlog = false;
     }
     else
-      state.ataerrorcount = errcnt1;
+      state.ataerrorcount = state.last_errcnt = errcnt1;
   }
 
   if (cfg.xerrorlog) {
     int errcnt2;
     if (!(   cfg.permissive || cfg.firmwarebugs.is_set(BUG_NOLOGDIR)
-          || (gp_logdir_ok && gp_logdir.entry[0x03-1].numsectors)   )) {
+          || (gp_logdir_ok && ataGetNumLogSectors(&gp_logdir, 0x03, true))   )) {
       PrintOut(LOG_INFO, "Device: %s, no Extended Comprehensive SMART Error Log, ignoring -l xerror (override with -T permissive)\n",
                name);
       cfg.xerrorlog = false;
@@ -2050,9 +2311,10 @@ static int ATADeviceScan(dev_config & cfg, dev_state & state, ata_device * atade
       // Record max error count
       if (errcnt2 > state.ataerrorcount)
         state.ataerrorcount = errcnt2;
+      state.last_xerrcnt = errcnt2;
     }
     else
-      state.ataerrorcount = errcnt2;
+      state.ataerrorcount = state.last_xerrcnt = errcnt2;
   }
 
   // capability check: self-test and offline data collection status
@@ -2066,6 +2328,23 @@ static int ATADeviceScan(dev_config & cfg, dev_state & state, ata_device * atade
     }
   }
 
+  // capability check: selective self-test for surface scan
+  if (cfg.scan_chunks) {
+    if (!(smart_val_ok && isSupportSelectiveSelfTest(&state.smartval))) {
+      PrintOut(LOG_INFO, "Device: %s, no SMART Selective Self-test capability, ignoring -b\n", name);
+      cfg.scan_chunks = 0;
+    }
+    else if (!state.num_sectors) {
+      PrintOut(LOG_INFO, "Device: %s, disk size is unknown, ignoring -b\n", name);
+      cfg.scan_chunks = 0;
+    }
+    else if (state.scan_chunk >= cfg.scan_chunks) {
+      // Number of chunks was changed, restart pass
+      state.scan_chunk = 0;
+      state.scan_pass_start = 0;
+    }
+  }
+
   // capabilities check -- does it support powermode?
   if (cfg.powermode) {
     int powermode = ataCheckPowerMode(atadev);
@@ -2134,6 +2413,32 @@ static int ATADeviceScan(dev_config & cfg, dev_state & state, ata_device * atade
                name, cfg.sct_erc_readtime, cfg.sct_erc_writetime);
   }
 
+  // register position in SCT temperature history, only newer samples are merged
+  if (cfg.scttemp_interval) {
+    ata_sct_temperature_history_table tmh;
+    if (!isSCTDataTableCapable(&drive)) {
+      PrintOut(LOG_INFO, "Device: %s, no SCT Data Table support, ignoring -l scttemp\n", name);
+      cfg.scttemp_interval = 0;
+    }
+    else if (locked) {
+      PrintOut(LOG_INFO, "Device: %s, no SCT support if ATA Security is LOCKED, ignoring -l scttemp\n",
+               name);
+      cfg.scttemp_interval = 0;
+    }
+    else if (!read_sct_temp_history(atadev, tmh)) {
+      PrintOut(LOG_INFO, "Device: %s, Read SCT Temperature History failed, ignoring -l scttemp\n",
+               name);
+      cfg.scttemp_interval = 0;
+    }
+    else {
+      state.scttemp_index = tmh.cb_index;
+      state.scttemp_time = time(0);
+      if (debugmode)
+        PrintOut(LOG_INFO, "Device: %s, SCT Temperature History has %u entries of %u minutes\n",
+                 name, tmh.cb_size, tmh.interval);
+    }
+  }
+
   // If no tests available or selected, return
   if (!(   cfg.smartcheck  || cfg.selftest
         || cfg.errorlog    || cfg.xerrorlog
@@ -2172,6 +2477,73 @@ static int ATADeviceScan(dev_config & cfg, dev_state & state, ata_device * atade
   return 0;
 }
 
+// Return number of elements in grown defect list, -1 on error.
+// Reads the list header only.
+static int64_t scsi_get_grown_defects(scsi_device * scsidev)
+{
+  UINT8 buf[8];
+  scsi_defect_list_info dli;
+  if (scsiReadDefectList(scsidev, 0 /* req_plist */, 1 /* req_glist */,
+                         4 /* format: bytes from index */, &dli, 0, 0, buf, sizeof(buf)))
+    return -1;
+  if (!dli.glist || !dli.desc_len)
+    return -1;
+  return dli.num;
+}
+
+// Check number of elements in grown defect list ('-G N' directive)
+static void CheckGrownDefects(const dev_config & cfg, dev_state & state, int64_t newcnt)
+{
+  const char * name = cfg.name.c_str();
+  if (newcnt < 0) {
+    PrintOut(LOG_INFO, "Device: %s, failed to read Grown Defect List\n", name);
+    return;
+  }
+
+  uint64_t oldcnt = state.scsi_grown_defects;
+  if ((uint64_t)newcnt > oldcnt) {
+    uint64_t diff = newcnt - oldcnt;
+    if (diff >= cfg.grown_defects_warn) {
+      PrintOut(LOG_CRIT, "Device: %s, Grown Defect List increased from %" PRIu64 " to %" PRId64
+               " (+%" PRIu64 " since last check)\n", name, oldcnt, newcnt, diff);
+      MailWarning(cfg, state, 13, "Device: %s, Grown Defect List increased from %" PRIu64 " to %" PRId64
+                  " (+%" PRIu64 " since last check)", name, oldcnt, newcnt, diff);
+    }
+    else
+      PrintOut(LOG_INFO, "Device: %s, Grown Defect List increased from %" PRIu64 " to %" PRId64 "\n",
+               name, oldcnt, newcnt);
+  }
+  else if ((uint64_t)newcnt < oldcnt) {
+    // List may be cleared by FORMAT UNIT
+    PrintOut(LOG_INFO, "Device: %s, Grown Defect List decreased from %" PRIu64 " to %" PRId64 "\n",
+             name, oldcnt, newcnt);
+    reset_warning_mail(cfg, state, 13, "Grown Defect List decreased");
+  }
+  else
+    return;
+
+  state.scsi_grown_defects = newcnt;
+  state.must_write = true;
+}
+
+// Read error counters of all SAS phys, return number of phys or -1 on error
+static int scsi_read_sas_phys(scsi_device * scsidev, std::vector<scsiSasPhyCounters> & phys)
+{
+  UINT8 tBuf[1024];
+  if (scsiLogSense(scsidev, PROTOCOL_SPECIFIC_LPAGE, 0, tBuf, sizeof(tBuf), 0))
+    return -1;
+  scsiSasPhyCounters pc[32];
+  int n = scsiDecodeSasPhyCounters(tBuf, sizeof(tBuf), pc, sizeof(pc)/sizeof(pc[0]));
+  if (n < 0)
+    return -1;
+  phys.assign(pc, pc + n);
+  return n;
+}
+
+// Buffer size for complete background scan results log page
+// (status parameter and up to 2048 medium scan entries)
+#define SCSI_BMS_RESP_LEN (4 + 20 + 0x800 * 24)
+
 // on success, return 0. On failure, return >0.  Never return <0,
 // please.
 static int SCSIDeviceScan(dev_config & cfg, dev_state & state, scsi_device * scsidev)
@@ -2354,9 +2726,10 @@ static int SCSIDeviceScan(dev_config & cfg, dev_state & state, scsi_device * scs
   }
   
   // capability check: self-test-log
+  // register newest self-test log entry, only newer entries are checked
+  scsi_selftest_track sttrack = { 0, 0, 0, 0, 0, -1 };
   if (cfg.selftest){
-    int retval = scsiCountFailedSelfTests(scsidev, 0);
-    if (retval<0) {
+    if (scsiTrackSelfTests(scsidev, &sttrack, 0)) {
       // no self-test log, turn off monitoring
       PrintOut(LOG_INFO, "Device: %s, does not support SMART Self-Test Log.\n", device);
       cfg.selftest = false;
@@ -2365,9 +2738,48 @@ static int SCSIDeviceScan(dev_config & cfg, dev_state & state, scsi_device * scs
     }
     else {
       // register starting values to watch for changes
-      state.selflogcount=SELFTEST_ERRORCOUNT(retval);
-      state.selfloghour =SELFTEST_ERRORHOURS(retval);
+      state.selflogcount = (sttrack.new_fails < 0xff ? sttrack.new_fails : 0xff);
+      state.selfloghour  = sttrack.fail_hour;
+    }
+  }
+
+  // capability check: background scan results log
+  scsi_bms_track bmstrack = { 0, 0, 0, 0, 0, 0 };
+  if (cfg.backgroundlog) {
+    unsigned char * buf = scsidev->get_io_buffer(SCSI_BMS_RESP_LEN, false);
+    if (scsiTrackBackgroundResults(scsidev, &bmstrack, buf, SCSI_BMS_RESP_LEN)) {
+      PrintOut(LOG_INFO, "Device: %s, does not support Background Scan Results Log\n", device);
+      cfg.backgroundlog = false;
+    }
+  }
+
+  // capability check: SAS phy error counters
+  if (cfg.sasphy_warn) {
+    int n = scsi_read_sas_phys(scsidev, state.sas_phys);
+    if (n <= 0) {
+      PrintOut(LOG_INFO, "Device: %s, does not support SAS Protocol Specific Log Page, "
+               "ignoring -l sasphy\n", device);
+      cfg.sasphy_warn = 0;
+    }
+    else {
+      state.sas_phys_time = time(0);
+      if (debugmode)
+        PrintOut(LOG_INFO, "Device: %s, tracking error counters of %d SAS phy(s)\n", device, n);
+    }
+  }
+
+  // capability check: grown defect list
+  int64_t grown_defects = -1;
+  if (cfg.grown_defects_warn) {
+    grown_defects = scsi_get_grown_defects(scsidev);
+    if (grown_defects < 0) {
+      PrintOut(LOG_INFO, "Device: %s, does not support Grown Defect List, ignoring -G %u\n",
+               device, cfg.grown_defects_warn);
+      cfg.grown_defects_warn = 0;
     }
+    else
+      PrintOut(LOG_INFO, "Device: %s, %" PRId64 " elements in Grown Defect List\n",
+               device, grown_defects);
   }
   
   // disable autosave (set GLTSD bit)
@@ -2412,6 +2824,30 @@ static int SCSIDeviceScan(dev_config & cfg, dev_state & state, scsi_device * scs
       cfg.attrlog_file = strprintf("%s%s-%s-%s.scsi.csv", attrlog_path_prefix.c_str(), vendor, model, serial);
   }
 
+  // register starting position in logs if not read from state file,
+  // a key of 0 (empty log) read from state file is valid
+  if (cfg.selftest && !(state.scsi_log_keys_valid & 0x01)) {
+    state.scsi_selftest_last_key = sttrack.last_key;
+    state.scsi_selftest_last_count = sttrack.last_count;
+    state.scsi_log_keys_valid |= 0x01;
+  }
+  if (cfg.backgroundlog && !(state.scsi_log_keys_valid & 0x02)) {
+    state.scsi_bms_last_key = bmstrack.last_key;
+    state.scsi_log_keys_valid |= 0x02;
+  }
+
+  // register starting value if not read from state file,
+  // otherwise check growth since state was saved
+  if (grown_defects >= 0) {
+    if (state.scsi_log_keys_valid & 0x04)
+      CheckGrownDefects(cfg, state, grown_defects);
+    else {
+      state.scsi_grown_defects = grown_defects;
+      state.scsi_log_keys_valid |= 0x04;
+      state.must_write = true;
+    }
+  }
+
   finish_device_scan(cfg, state);
 
   return 0;
@@ -2442,7 +2878,10 @@ static int nvme_get_max_temp_kelvin(const nvme_smart_log & smart_log)
   return k;
 }
 
-static int NVMeDeviceScan(dev_config & cfg, dev_state & state, nvme_device * nvmedev)
+// Returns 4 if the NVMe controller is already monitored through
+// another namespace in CONFIGS
+static int NVMeDeviceScan(dev_config & cfg, dev_state & state, nvme_device * nvmedev,
+                          const dev_config_vector & configs)
 {
   const char *name = cfg.name.c_str();
 
@@ -2475,6 +2914,18 @@ static int NVMeDeviceScan(dev_config & cfg, dev_state & state, nvme_device * nvm
 
   PrintOut(LOG_INFO, "Device: %s, %s\n", name, cfg.dev_idinfo.c_str());
 
+  // All logs checked below are controller scoped, so namespaces of the
+  // same controller would only repeat the same commands and warnings
+  cfg.nvme_ctrl_id = strprintf("%s, S/N:%s, CNTLID:%u", model, serial, id_ctrl.cntlid);
+  for (unsigned i = 0; i < configs.size(); i++) {
+    if (configs[i].nvme_ctrl_id != cfg.nvme_ctrl_id)
+      continue;
+    PrintOut(LOG_INFO, "Device: %s, same NVMe controller as %s, ignored\n", name,
+             configs[i].name.c_str());
+    CloseDevice(nvmedev, name);
+    return 4;
+  }
+
   // Read SMART/Health log
   nvme_smart_log smart_log;
   if (!nvme_read_smart_log(nvmedev, smart_log)) {
@@ -2788,6 +3239,9 @@ static int DoSCSISelfTest(const dev_config & cfg, dev_state & state, scsi_device
     return 1;
   }
   
+  // Force self-test log check in next call
+  state.selftest_started = true;
+
   PrintOut(LOG_INFO, "Device: %s, starting scheduled %s-Test.\n", name, testname);
   
   return 0;
@@ -2912,6 +3366,113 @@ static int DoATASelfTest(const dev_config & cfg, dev_state & state, ata_device *
   return 0;
 }
 
+// Number of devices with surface scan chunk in progress for each group,
+// recounted from device states in each check cycle.
+static std::map<std::string, unsigned> scan_group_busy;
+
+// Surface scan planner ('-b' directive).  Checks whether the chunk in
+// progress has finished and starts the next chunk as a selective
+// self-test if the budget of the device group allows.
+// 'curval' are the SMART values read in this cycle, if any.
+static void DoATASurfaceScan(const dev_config & cfg, dev_state & state, ata_device * device,
+                             const ata_smart_values * curval)
+{
+  const char * name = cfg.name.c_str();
+  struct ata_smart_values data;
+  if (curval)
+    data = *curval;
+  else if (ataReadSmartValues(device, &data)) {
+    PrintOut(LOG_INFO, "Device: %s, Read SMART Values failed, surface scan delayed\n", name);
+    return;
+  }
+
+  bool busy = (data.self_test_exec_status >> 4) == 15;
+  if (state.scan_running) {
+    if (busy)
+      return; // Chunk still in progress
+
+    state.scan_running = false;
+    state.must_write = true;
+    unsigned & cnt = scan_group_busy[cfg.scan_group];
+    if (cnt > 0)
+      cnt--;
+
+    switch (data.self_test_exec_status >> 4) {
+      case 1: case 2: // Aborted/Interrupted by host
+        PrintOut(LOG_INFO, "Device: %s, surface scan chunk %u of %u interrupted, will be redone\n",
+                 name, state.scan_chunk + 1, cfg.scan_chunks);
+        break;
+      default:
+        // Errors are reported by '-l selftest'
+        PrintOut(LOG_INFO, "Device: %s, surface scan chunk %u of %u finished%s\n",
+                 name, state.scan_chunk + 1, cfg.scan_chunks,
+                 (data.self_test_exec_status ? " with error" : ""));
+        if (++state.scan_chunk >= cfg.scan_chunks) {
+          PrintOut(LOG_INFO, "Device: %s, surface scan pass finished after %d hours\n", name,
+                   (state.scan_pass_start ? (int)((time(0) - state.scan_pass_start) / 3600) : 0));
+          state.scan_chunk = 0;
+          state.scan_pass_start = 0;
+        }
+        break;
+    }
+  }
+  else if (busy)
+    return; // Other test in progress
+
+  // Check budget of device group
+  if (!cfg.scan_group.empty()) {
+    unsigned & cnt = scan_group_busy[cfg.scan_group];
+    if (cnt >= cfg.scan_group_max) {
+      if (debugmode)
+        PrintOut(LOG_INFO, "Device: %s, surface scan delayed, %u device(s) of group %s busy\n",
+                 name, cnt, cfg.scan_group.c_str());
+      return;
+    }
+  }
+
+  if (!isSupportSelectiveSelfTest(&data)) {
+    PrintOut(LOG_CRIT, "Device: %s, not capable of Selective Self-Test, surface scan stopped\n", name);
+    state.not_cap_selective = true;
+    return;
+  }
+
+  // Set span of next chunk
+  uint64_t start = state.num_sectors *  state.scan_chunk      / cfg.scan_chunks;
+  uint64_t end   = state.num_sectors * (state.scan_chunk + 1) / cfg.scan_chunks - 1;
+  ata_selective_selftest_args selargs;
+  selargs.num_spans = 1;
+  selargs.span[0].mode = SEL_RANGE;
+  selargs.span[0].start = start;
+  selargs.span[0].end = end;
+  if (ataWriteSelectiveSelfTestLog(device, selargs, &data, state.num_sectors)) {
+    PrintOut(LOG_CRIT, "Device: %s, prepare surface scan chunk failed\n", name);
+    return;
+  }
+  if (smartcommandhandler(device, IMMEDIATE_OFFLINE, SELECTIVE_SELF_TEST, NULL)) {
+    PrintOut(LOG_CRIT, "Device: %s, execute surface scan chunk failed.\n", name);
+    return;
+  }
+
+  time_t now = time(0);
+  if (!state.scan_pass_start)
+    state.scan_pass_start = now;
+  state.scan_running = true;
+  state.selftest_started = true;
+  state.must_write = true;
+  scan_group_busy[cfg.scan_group]++;
+
+  PrintOut(LOG_INFO, "Device: %s, starting surface scan chunk %u of %u at LBA %" PRIu64 " - %" PRIu64 "\n",
+           name, state.scan_chunk + 1, cfg.scan_chunks, start, end);
+
+  // Estimate end of pass from the chunks done so far
+  if (state.scan_chunk > 0 && now > state.scan_pass_start) {
+    time_t passend = now + (time_t)((now - state.scan_pass_start)
+                     * (double)(cfg.scan_chunks - state.scan_chunk) / state.scan_chunk);
+    char datebuf[DATEANDEPOCHLEN]; dateandtimezoneepoch(datebuf, passend);
+    PrintOut(LOG_INFO, "Device: %s, surface scan pass is expected to finish at %s\n", name, datebuf);
+  }
+}
+
 // Check pending sector count attribute values (-C, -U directives).
 static void check_pending(const dev_config & cfg, dev_state & state,
                           unsigned char id, bool increase_only,
@@ -2919,19 +3480,19 @@ static void check_pending(const dev_config & cfg, dev_state & state,
                           int mailtype, const char * msg)
 {
   // Find attribute index
-  int i = ata_find_attr_index(id, smartval);
+  int i = state.attrplan.find_index(id);
   if (!(i >= 0 && ata_find_attr_index(id, state.smartval) == i))
     return;
 
   // No report if no sectors pending.
-  uint64_t rawval = ata_get_attr_raw_value(smartval.vendor_attributes[i], cfg.attribute_defs);
+  uint64_t rawval = state.attrplan.get_raw_value(smartval.vendor_attributes[i], i);
   if (rawval == 0) {
     reset_warning_mail(cfg, state, mailtype, "No more %s", msg);
     return;
   }
 
   // If attribute is not reset, report only sector count increases.
-  uint64_t prev_rawval = ata_get_attr_raw_value(state.smartval.vendor_attributes[i], cfg.attribute_defs);
+  uint64_t prev_rawval = state.attrplan.get_raw_value(state.smartval.vendor_attributes[i], i);
   if (!(!increase_only || prev_rawval < rawval))
     return;
 
@@ -3028,15 +3589,125 @@ static void CheckTemperature(const dev_config & cfg, dev_state & state, unsigned
   }
 }
 
+// Read SCT Temperature History table if due and merge the samples added
+// since last read into Min/Max Temperature and limit checks.
+// This catches temperature peaks between checks.
+static void CheckSCTTempHistory(const dev_config & cfg, dev_state & state, ata_device * atadev)
+{
+  time_t now = time(0);
+  if (now < state.scttemp_time + cfg.scttemp_interval * 60)
+    return;
+
+  const char * name = cfg.name.c_str();
+  ata_sct_temperature_history_table tmh;
+  if (!read_sct_temp_history(atadev, tmh)) {
+    PrintOut(LOG_INFO, "Device: %s, Read SCT Temperature History failed\n", name);
+    state.scttemp_time = now; // Retry at next interval
+    return;
+  }
+
+  unsigned size = tmh.cb_size, index = tmh.cb_index, num = 0;
+  if (state.scttemp_index >= 0) {
+    num = (index + size - state.scttemp_index) % size;
+    // All entries are new if the buffer has wrapped since last read
+    int minutes = (int)((now - state.scttemp_time) / 60);
+    if (tmh.interval && (unsigned)minutes / tmh.interval >= size)
+      num = size;
+  }
+  state.scttemp_index = index;
+  state.scttemp_time = now;
+
+  // Find Min/Max of new valid samples, newest first
+  int tmin = 255, tmax = 0, valid = 0;
+  for (unsigned k = 0; k < num; k++) {
+    int t = tmh.cb[(index + size - k) % size];
+    if (t == -128) // no sample (device was off)
+      continue;
+    if (t < 1)
+      t = 1;
+    else if (t > 254)
+      t = 254;
+    if (t < tmin)
+      tmin = t;
+    if (t > tmax)
+      tmax = t;
+    valid++;
+  }
+  if (debugmode)
+    PrintOut(LOG_INFO, "Device: %s, %d new SCT Temperature History samples (Min/Max %d/%d)\n",
+             name, valid, (valid ? tmin : 0), (valid ? tmax : 0));
+  if (!valid)
+    return;
+
+  char buf[20];
+  const char * minchg = "", * maxchg = "";
+  if (tmax > state.tempmax) {
+    if (state.tempmax)
+      maxchg = "!";
+    state.tempmax = tmax;
+    state.must_write = true;
+  }
+  if (!state.tempmin_delay && state.tempmin && tmin < state.tempmin) {
+    state.tempmin = tmin;
+    minchg = "!";
+    state.must_write = true;
+  }
+  if (cfg.tempdiff && (*minchg || *maxchg))
+    PrintOut(LOG_INFO, "Device: %s, Temperature History reports %d-%d Celsius (Min/Max %s%s/%u%s)\n",
+      name, tmin, tmax, fmt_temp(state.tempmin, buf), minchg, state.tempmax, maxchg);
+
+  // Check limits, Temperature may have dropped again since
+  int minutes = valid * (tmh.interval ? tmh.interval : 1);
+  if (cfg.tempcrit && tmax >= cfg.tempcrit) {
+    PrintOut(LOG_CRIT, "Device: %s, Temperature History reports %d Celsius within last %d minutes, "
+      "critical limit is %u Celsius\n", name, tmax, minutes, cfg.tempcrit);
+    MailWarning(cfg, state, 12, "Device: %s, Temperature History reports %d Celsius within last %d minutes, "
+      "critical limit is %u Celsius", name, tmax, minutes, cfg.tempcrit);
+  }
+  else if (cfg.tempinfo && tmax >= cfg.tempinfo)
+    PrintOut(LOG_INFO, "Device: %s, Temperature History reports %d Celsius within last %d minutes, "
+      "limit is %u Celsius\n", name, tmax, minutes, cfg.tempinfo);
+}
+
+// Return digest (64-bit FNV-1a hash) of a data block.
+static uint64_t get_data_digest(const void * data, unsigned size)
+{
+  const unsigned char * p = (const unsigned char *)data;
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (unsigned i = 0; i < size; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+// Return true if the SMART data with this digest was already checked
+// and the last full check is not older than FULLCHECKTIME.
+// Otherwise save digest and time of this (full) check.
+static bool is_data_unchanged(const dev_config & cfg, dev_state & state,
+                              uint64_t digest, bool force)
+{
+  time_t now = time(0);
+  if (   !force && state.full_check_time && digest == state.data_digest
+      && state.full_check_time <= now && now < state.full_check_time + FULLCHECKTIME) {
+    if (debugmode)
+      PrintOut(LOG_INFO, "Device: %s, SMART data unchanged, skipping checks\n",
+               cfg.name.c_str());
+    return true;
+  }
+  state.data_digest = digest;
+  state.full_check_time = now;
+  return false;
+}
+
 // Check normalized and raw attribute values.
 static void check_attribute(const dev_config & cfg, dev_state & state,
                             const ata_smart_attribute & attr,
                             const ata_smart_attribute & prev,
-                            int attridx,
-                            const ata_smart_threshold_entry * thresholds)
+                            int attridx)
 {
   // Check attribute and threshold
-  ata_attr_state attrstate = ata_get_attr_state(attr, attridx, thresholds, cfg.attribute_defs);
+  ata_attr_state attrstate = state.attrplan.get_state(attr, attridx);
   if (attrstate == ATTRSTATE_NON_EXISTING)
     return;
 
@@ -3076,8 +3747,8 @@ static void check_attribute(const dev_config & cfg, dev_state & state,
   // Compare raw values if requested.
   bool rawchanged = false;
   if (cfg.monitor_attr_flags.is_set(attr.id, MONITOR_RAW)) {
-    if (   ata_get_attr_raw_value(attr, cfg.attribute_defs)
-        != ata_get_attr_raw_value(prev, cfg.attribute_defs))
+    if (   state.attrplan.get_raw_value(attr, attridx)
+        != state.attrplan.get_raw_value(prev, attridx))
       rawchanged = true;
   }
 
@@ -3140,6 +3811,7 @@ static int ATACheckDevice(const dev_config & cfg, dev_state & state, ata_device
   // power mode first before opening the device for full access,
   // and exit without check if disk is reported in standby.
   if (cfg.powermode && !state.powermodefail) {
+    state.timing.set_phase(PHASE_POWERMODE);
     // Note that 'is_powered_down()' handles opening the device itself, and
     // can be used before calling 'open()' (that's the whole point of 'is_powered_down()'!).
     if (atadev->is_powered_down())
@@ -3161,7 +3833,7 @@ static int ATACheckDevice(const dev_config & cfg, dev_state & state, ata_device
   // perhaps the next time around we'll be able to open it.  ATAPI
   // cd/dvd devices will hang awaiting media if O_NONBLOCK is not
   // given (see linux cdrom driver).
-  if (!atadev->open()) {
+  if (!OpenDevice(state, atadev)) {
     PrintOut(LOG_INFO, "Device: %s, open() failed: %s\n", name, atadev->get_errmsg());
     MailWarning(cfg, state, 9, "Device: %s, unable to open device", name);
     return 1;
@@ -3174,6 +3846,7 @@ static int ATACheckDevice(const dev_config & cfg, dev_state & state, ata_device
   // alone if it is in idle or sleeping mode.  In this case check the
   // power mode and exit without check if needed
   if (cfg.powermode && !state.powermodefail) {
+    state.timing.set_phase(PHASE_POWERMODE);
     int dontcheck=0, powermode=ataCheckPowerMode(atadev);
     const char * mode = 0;
     if (0 <= powermode && powermode < 0xff) {
@@ -3249,7 +3922,7 @@ static int ATACheckDevice(const dev_config & cfg, dev_state & state, ata_device
     if (dontcheck){
       // skip at most powerskipmax checks
       if (!cfg.powerskipmax || state.powerskipcnt<cfg.powerskipmax) {
-        CloseDevice(atadev, name);
+        CloseDeviceAfterCheck(state, atadev, name);
         // report first only except if state has changed, avoid waking up system disk
         if ((!state.powerskipcnt || state.lastpowermodeskipped != powermode) && !cfg.powerquiet) {
           PrintOut(LOG_INFO, "Device: %s, is in %s mode, suspending checks\n", name, mode);
@@ -3274,6 +3947,7 @@ static int ATACheckDevice(const dev_config & cfg, dev_state & state, ata_device
   }
 
   // check smart status
+  state.timing.set_phase(PHASE_SMART);
   if (cfg.smartcheck) {
     int status=ataSmartStatus2(atadev);
     if (status==-1){
@@ -3289,6 +3963,9 @@ static int ATACheckDevice(const dev_config & cfg, dev_state & state, ata_device
   }
   
   // Check everything that depends upon SMART Data (eg, Attribute values)
+  bool smart_data_unchanged = false;
+  bool selftest_sts_changed = true;
+  bool smartval_read = false;
   if (   cfg.usagefailed || cfg.prefail || cfg.usage
       || cfg.curr_pending_id || cfg.offl_pending_id
       || cfg.tempdiff || cfg.tempinfo || cfg.tempcrit
@@ -3304,13 +3981,22 @@ static int ATACheckDevice(const dev_config & cfg, dev_state & state, ata_device
     else {
       reset_warning_mail(cfg, state, 6, "read SMART Attribute Data worked again");
 
+      // Resolve attributes again if table layout has changed
+      if (!state.attrplan.matches(curval))
+        state.attrplan.init(curval, state.smartthres.thres_entries, cfg.attribute_defs);
+
+      // Skip attribute and log checks below if nothing has changed
+      smart_data_unchanged = is_data_unchanged(cfg, state,
+        get_data_digest(&curval, sizeof(curval)),
+        (firstpass || state.offline_started || state.selftest_started));
+
       // look for current or offline pending sectors
-      if (cfg.curr_pending_id)
+      if (cfg.curr_pending_id && !smart_data_unchanged)
         check_pending(cfg, state, cfg.curr_pending_id, cfg.curr_pending_incr, curval, 10,
                       (!cfg.curr_pending_incr ? "Currently unreadable (pending) sectors"
                                               : "Total unreadable (pending) sectors"    ));
 
-      if (cfg.offl_pending_id)
+      if (cfg.offl_pending_id && !smart_data_unchanged)
         check_pending(cfg, state, cfg.offl_pending_id, cfg.offl_pending_incr, curval, 11,
                       (!cfg.offl_pending_incr ? "Offline uncorrectable sectors"
                                               : "Total offline uncorrectable sectors"));
@@ -3319,13 +4005,16 @@ static int ATACheckDevice(const dev_config & cfg, dev_state & state, ata_device
       if (cfg.tempdiff || cfg.tempinfo || cfg.tempcrit)
         CheckTemperature(cfg, state, ata_return_temperature_value(&curval, cfg.attribute_defs), 0);
 
+      // merge temperature samples recorded by the device since last read
+      if (cfg.scttemp_interval)
+        CheckSCTTempHistory(cfg, state, atadev);
+
       // look for failed usage attributes, or track usage or prefail attributes
-      if (cfg.usagefailed || cfg.prefail || cfg.usage) {
+      if ((cfg.usagefailed || cfg.prefail || cfg.usage) && !smart_data_unchanged) {
         for (int i = 0; i < NUMBER_ATA_SMART_ATTRIBUTES; i++) {
           check_attribute(cfg, state,
                           curval.vendor_attributes[i],
-                          state.smartval.vendor_attributes[i],
-                          i, state.smartthres.thres_entries);
+                          state.smartval.vendor_attributes[i], i);
         }
       }
 
@@ -3338,6 +4027,12 @@ static int ATACheckDevice(const dev_config & cfg, dev_state & state, ata_device
           log_offline_data_coll_status(name, curval.offline_data_collection_status);
       }
 
+      // A new self-test log entry is only expected if the self-test
+      // execution status has changed
+      selftest_sts_changed = (   curval.self_test_exec_status
+                                  != state.smartval.self_test_exec_status
+                              || state.selftest_started);
+
       // Log changes of self-test execution status
       if (cfg.selfteststs) {
         if (   curval.self_test_exec_status != state.smartval.self_test_exec_status
@@ -3348,22 +4043,51 @@ static int ATACheckDevice(const dev_config & cfg, dev_state & state, ata_device
 
       // Save the new values for the next time around
       state.smartval = curval;
+      smartval_read = true;
     }
   }
   state.offline_started = state.selftest_started = false;
-  
+
+  // Read all enabled logs unconditionally at least once per FULLCHECKTIME
+  state.timing.set_phase(PHASE_LOGS);
+  bool force_log_read = false;
+  if ((cfg.selftest || cfg.errorlog || cfg.xerrorlog) && !smart_data_unchanged) {
+    time_t now = time(0);
+    if (!(state.log_check_time <= now && now < state.log_check_time + FULLCHECKTIME)) {
+      force_log_read = true;
+      state.log_check_time = now;
+    }
+  }
+
   // check if number of selftest errors has increased (note: may also DECREASE)
-  if (cfg.selftest)
-    CheckSelfTestLogs(cfg, state, SelfTestErrorCount(atadev, name, cfg.firmwarebugs));
+  if (cfg.selftest && !smart_data_unchanged) {
+    if (selftest_sts_changed || force_log_read)
+      CheckSelfTestLogs(cfg, state, SelfTestErrorCount(atadev, name, cfg.firmwarebugs));
+    else if (debugmode)
+      PrintOut(LOG_INFO, "Device: %s, self-test execution status unchanged, skipping Self-test Log\n", name);
+  }
 
   // check if number of ATA errors has increased
-  if (cfg.errorlog || cfg.xerrorlog) {
+  if ((cfg.errorlog || cfg.xerrorlog) && !smart_data_unchanged) {
 
-    int errcnt1 = -1, errcnt2 = -1;
-    if (cfg.errorlog)
-      errcnt1 = read_ata_error_count(atadev, name, cfg.firmwarebugs, false);
-    if (cfg.xerrorlog)
+    // If both logs are monitored, the Summary Error Log is only read
+    // if the count in the first sector of the Extended Log has changed
+    int errcnt1 = -1, errcnt2 = -1, prev_xerrcnt = state.last_xerrcnt;
+    if (cfg.xerrorlog) {
       errcnt2 = read_ata_error_count(atadev, name, cfg.firmwarebugs, true);
+      if (errcnt2 >= 0)
+        state.last_xerrcnt = errcnt2;
+    }
+    if (cfg.errorlog) {
+      if (   force_log_read || errcnt2 < 0 || state.last_errcnt < 0
+          || errcnt2 != prev_xerrcnt) {
+        errcnt1 = read_ata_error_count(atadev, name, cfg.firmwarebugs, false);
+        if (errcnt1 >= 0)
+          state.last_errcnt = errcnt1;
+      }
+      else
+        errcnt1 = state.last_errcnt;
+    }
 
     // new number of errors is max of both logs
     int newc = (errcnt1 >= errcnt2 ? errcnt1 : errcnt2);
@@ -3389,15 +4113,23 @@ static int ATACheckDevice(const dev_config & cfg, dev_state & state, ata_device
 
   // if the user has asked, and device is capable (or we're not yet
   // sure) check whether a self test should be done now.
+  char testtype = 0;
   if (allow_selftests && !cfg.test_regex.empty()) {
-    char testtype = next_scheduled_test(cfg, state, false/*!scsi*/);
+    state.timing.set_phase(PHASE_SELFTEST);
+    testtype = next_scheduled_test(cfg, state, false/*!scsi*/);
     if (testtype)
       DoATASelfTest(cfg, state, atadev, testtype);
   }
 
+  // continue surface scan if no scheduled test was due
+  if (allow_selftests && cfg.scan_chunks && !testtype && !state.not_cap_selective) {
+    state.timing.set_phase(PHASE_SELFTEST);
+    DoATASurfaceScan(cfg, state, atadev, (smartval_read ? &state.smartval : 0));
+  }
+
   // Don't leave device open -- the OS/user may want to access it
-  // before the next smartd cycle!
-  CloseDevice(atadev, name);
+  // before the next smartd cycle! (unless '-k N' is specified)
+  CloseDeviceAfterCheck(state, atadev, name);
 
   // Copy ATA attribute values to persistent state
   state.update_persistent_state();
@@ -3405,6 +4137,165 @@ static int ATACheckDevice(const dev_config & cfg, dev_state & state, ata_device
   return 0;
 }
 
+// Return true if SCSI log page differs from the page seen in last call.
+static bool is_scsi_page_changed(dev_state & state, int idx, const UINT8 * page)
+{
+  unsigned len = ((page[2] << 8) | page[3]) + 4;
+  if (len > 252)
+    len = 252;
+  uint64_t digest = get_data_digest(page, len);
+  if (state.scsi_ecounter_digest[idx] && digest == state.scsi_ecounter_digest[idx])
+    return false;
+  state.scsi_ecounter_digest[idx] = digest;
+  return true;
+}
+
+// Check new entries in SCSI self-test log ('-l selftest' directive)
+static void CheckSCSISelfTestLog(const dev_config & cfg, dev_state & state, scsi_device * scsidev)
+{
+  const char * name = cfg.name.c_str();
+  scsi_selftest_track st = { state.scsi_selftest_last_key,
+                             state.scsi_selftest_last_count, 0, 0, 0, -1 };
+  if (scsiTrackSelfTests(scsidev, &st, 0)) {
+    MailWarning(cfg, state, 8, "Device: %s, Read SMART Self-Test Log Failed", name);
+    return;
+  }
+  reset_warning_mail(cfg, state, 8, "Read SMART Self-Test Log worked again");
+  if (!st.new_entries)
+    return;
+
+  if (debugmode)
+    PrintOut(LOG_INFO, "Device: %s, %d new Self-Test Log entries\n", name, st.new_entries);
+  if (st.new_fails) {
+    int oldc = state.selflogcount;
+    int newc = oldc + st.new_fails;
+    if (newc > 0xff)
+      newc = 0xff;
+    PrintOut(LOG_CRIT, "Device: %s, Self-Test Log error count increased from %d to %d, "
+             "newest error at hour timestamp %d\n", name, oldc, newc, st.fail_hour);
+    MailWarning(cfg, state, 3, "Device: %s, Self-Test Log error count increased from %d to %d, "
+                "newest error at hour timestamp %d", name, oldc, newc, st.fail_hour);
+    state.selflogcount = newc;
+    state.selfloghour = st.fail_hour;
+  }
+  else if (st.newest_result == 0 && state.selflogcount) {
+    // Newer successful self-test
+    PrintOut(LOG_INFO, "Device: %s, new successful self-test in Self-Test Log\n", name);
+    reset_warning_mail(cfg, state, 3, "Self-Test Log reports a successful self-test");
+    state.selflogcount = 0;
+    state.selfloghour = 0;
+  }
+  state.scsi_selftest_last_key = st.last_key;
+  state.scsi_selftest_last_count = st.last_count;
+  state.must_write = true;
+}
+
+// Check new entries in background scan results log ('-l background' directive)
+static void CheckSCSIBackgroundLog(const dev_config & cfg, dev_state & state, scsi_device * scsidev)
+{
+  const char * name = cfg.name.c_str();
+  scsi_bms_track bt = { state.scsi_bms_last_key, 0, 0, 0, 0, 0 };
+  unsigned char * buf = scsidev->get_io_buffer(SCSI_BMS_RESP_LEN, false);
+  int err = scsiTrackBackgroundResults(scsidev, &bt, buf, SCSI_BMS_RESP_LEN);
+  if (err) {
+    PrintOut(LOG_INFO, "Device: %s, failed to read Background Scan Results Log: %s\n",
+             name, scsiErrString(err));
+    return;
+  }
+  if (!bt.new_entries)
+    return;
+
+  if (bt.new_errors) {
+    unsigned m = bt.error_minutes;
+    if (bt.new_unrecovered) {
+      PrintOut(LOG_CRIT, "Device: %s, %d new medium error(s) found by background scan, "
+               "%d not recovered, newest at LBA %" PRIu64 " at %u:%02u hours\n",
+               name, bt.new_errors, bt.new_unrecovered, bt.error_lba, m / 60, m % 60);
+      MailWarning(cfg, state, 14, "Device: %s, %d new medium error(s) found by background scan, "
+                  "%d not recovered, newest at LBA %" PRIu64, name, bt.new_errors,
+                  bt.new_unrecovered, bt.error_lba);
+    }
+    else
+      PrintOut(LOG_INFO, "Device: %s, %d new medium error(s) found and recovered by background "
+               "scan, newest at LBA %" PRIu64 " at %u:%02u hours\n",
+               name, bt.new_errors, bt.error_lba, m / 60, m % 60);
+  }
+  else if (debugmode)
+    PrintOut(LOG_INFO, "Device: %s, %d new Background Scan Results Log entries\n",
+             name, bt.new_entries);
+
+  state.scsi_bms_last_key = bt.last_key;
+  state.must_write = true;
+}
+
+// Return increase of SAS phy error counter, counters may have been
+// reset by 'smartctl -l sasphy,reset'
+static inline unsigned sas_phy_delta(unsigned newval, unsigned oldval)
+{
+  return (newval >= oldval ? newval - oldval : newval);
+}
+
+// Check SAS phy error counters ('-l sasphy[,N]' directive)
+static void CheckSasPhyCounters(const dev_config & cfg, dev_state & state, scsi_device * scsidev)
+{
+  const char * name = cfg.name.c_str();
+  // Limit is N errors per hour, keep counters of last read until
+  // at least one hour has passed
+  time_t now = time(0);
+  int64_t secs = now - state.sas_phys_time;
+  if (0 <= secs && secs < 3600)
+    return;
+
+  std::vector<scsiSasPhyCounters> phys;
+  if (scsi_read_sas_phys(scsidev, phys) < 0) {
+    PrintOut(LOG_INFO, "Device: %s, failed to read SAS Protocol Specific Log Page\n", name);
+    return;
+  }
+  if (secs < 0) {
+    // Clock was set back, restart
+    state.sas_phys = phys;
+    state.sas_phys_time = now;
+    return;
+  }
+
+  bool warned = false;
+  for (unsigned i = 0; i < phys.size(); i++) {
+    const scsiSasPhyCounters & np = phys[i];
+    // Find same phy from last check, counters restart if not found
+    scsiSasPhyCounters op = np;
+    op.inv_dword = op.disparity = op.loss_sync = op.reset_prob = 0;
+    for (unsigned j = 0; j < state.sas_phys.size(); j++) {
+      if (state.sas_phys[j].port == np.port && state.sas_phys[j].phy_id == np.phy_id) {
+        op = state.sas_phys[j];
+        break;
+      }
+    }
+
+    unsigned d_dword = sas_phy_delta(np.inv_dword, op.inv_dword);
+    unsigned d_disp  = sas_phy_delta(np.disparity, op.disparity);
+    unsigned d_sync  = sas_phy_delta(np.loss_sync, op.loss_sync);
+    unsigned d_reset = sas_phy_delta(np.reset_prob, op.reset_prob);
+    uint64_t sum = (uint64_t)d_dword + d_disp + d_sync + d_reset;
+    if (!sum)
+      continue;
+
+    std::string msg = strprintf("Device: %s, SAS port %d phy %d error counters increased in %d minutes: "
+      "invalid DWORD +%u, disparity +%u, loss of sync +%u, phy reset problem +%u",
+      name, np.port, np.phy_id, (int)(secs / 60), d_dword, d_disp, d_sync, d_reset);
+    if (sum * 3600 >= (uint64_t)cfg.sasphy_warn * secs) {
+      PrintOut(LOG_CRIT, "%s\n", msg.c_str());
+      if (!warned) // One mail per check
+        MailWarning(cfg, state, 15, "%s", msg.c_str());
+      warned = true;
+    }
+    else
+      PrintOut(LOG_INFO, "%s\n", msg.c_str());
+  }
+
+  state.sas_phys = phys;
+  state.sas_phys_time = now;
+}
+
 static int SCSICheckDevice(const dev_config & cfg, dev_state & state, scsi_device * scsidev, bool allow_selftests)
 {
     const char * name = cfg.name.c_str();
@@ -3415,7 +4306,7 @@ static int SCSICheckDevice(const dev_config & cfg, dev_state & state, scsi_devic
 
     // if we can't open device, fail gracefully rather than hard --
     // perhaps the next time around we'll be able to open it
-    if (!scsidev->open()) {
+    if (!OpenDevice(state, scsidev)) {
       PrintOut(LOG_INFO, "Device: %s, open() failed: %s\n", name, scsidev->get_errmsg());
       MailWarning(cfg, state, 9, "Device: %s, unable to open device", name);
       return 1;
@@ -3423,6 +4314,7 @@ static int SCSICheckDevice(const dev_config & cfg, dev_state & state, scsi_devic
         PrintOut(LOG_INFO,"Device: %s, opened SCSI device\n", name);
     reset_warning_mail(cfg, state, 9, "open device worked again");
 
+    state.timing.set_phase(PHASE_SMART);
     UINT8 asc = 0, ascq = 0;
     UINT8 currenttemp = 0, triptemp = 0;
     if (!state.SuppressReport) {
@@ -3451,40 +4343,69 @@ static int SCSICheckDevice(const dev_config & cfg, dev_state & state, scsi_devic
     if (cfg.tempdiff || cfg.tempinfo || cfg.tempcrit || !cfg.attrlog_file.empty())
       CheckTemperature(cfg, state, currenttemp, triptemp);
 
-    // check if number of selftest errors has increased (note: may also DECREASE)
-    if (cfg.selftest)
-      CheckSelfTestLogs(cfg, state, scsiCountFailedSelfTests(scsidev, 0));
+    // Skip self-test log check if IE info and temperature are unchanged
+    bool ie_unchanged = false;
+    if (!state.SuppressReport) {
+      UINT8 ieinfo[4] = { asc, ascq, currenttemp, triptemp };
+      ie_unchanged = is_data_unchanged(cfg, state, get_data_digest(ieinfo, sizeof(ieinfo)),
+                                       (!state.full_check_time || state.selftest_started));
+    }
+
+    state.selftest_started = false;
+
+    // check new self-test log entries for failed self-tests
+    state.timing.set_phase(PHASE_LOGS);
+    if (cfg.selftest && !ie_unchanged)
+      CheckSCSISelfTestLog(cfg, state, scsidev);
+
+    // check for new medium errors found by background scans
+    if (cfg.backgroundlog)
+      CheckSCSIBackgroundLog(cfg, state, scsidev);
+
+    // check SAS phy error counters, counters are never reset
+    if (cfg.sasphy_warn)
+      CheckSasPhyCounters(cfg, state, scsidev);
+
+    // check if grown defect list has grown, header read is cheap
+    if (cfg.grown_defects_warn)
+      CheckGrownDefects(cfg, state, scsi_get_grown_defects(scsidev));
     
     if (allow_selftests && !cfg.test_regex.empty()) {
+      state.timing.set_phase(PHASE_SELFTEST);
       char testtype = next_scheduled_test(cfg, state, true/*scsi*/);
       if (testtype)
         DoSCSISelfTest(cfg, state, scsidev, testtype);
     }
     if (!cfg.attrlog_file.empty()){
-      // saving error counters to state
+      state.timing.set_phase(PHASE_LOGS);
+      // saving error counters to state, decode changed pages only
       UINT8 tBuf[252];
       if (state.ReadECounterPageSupported && (0 == scsiLogSense(scsidev,
-          READ_ERROR_COUNTER_LPAGE, 0, tBuf, sizeof(tBuf), 0))) {
+          READ_ERROR_COUNTER_LPAGE, 0, tBuf, sizeof(tBuf), 0))
+          && is_scsi_page_changed(state, 0, tBuf)) {
           scsiDecodeErrCounterPage(tBuf, &state.scsi_error_counters[0].errCounter);
           state.scsi_error_counters[0].found=1;
       }
       if (state.WriteECounterPageSupported && (0 == scsiLogSense(scsidev,
-          WRITE_ERROR_COUNTER_LPAGE, 0, tBuf, sizeof(tBuf), 0))) {
+          WRITE_ERROR_COUNTER_LPAGE, 0, tBuf, sizeof(tBuf), 0))
+          && is_scsi_page_changed(state, 1, tBuf)) {
           scsiDecodeErrCounterPage(tBuf, &state.scsi_error_counters[1].errCounter);
           state.scsi_error_counters[1].found=1;
       }
       if (state.VerifyECounterPageSupported && (0 == scsiLogSense(scsidev,
-          VERIFY_ERROR_COUNTER_LPAGE, 0, tBuf, sizeof(tBuf), 0))) {
+          VERIFY_ERROR_COUNTER_LPAGE, 0, tBuf, sizeof(tBuf), 0))
+          && is_scsi_page_changed(state, 2, tBuf)) {
           scsiDecodeErrCounterPage(tBuf, &state.scsi_error_counters[2].errCounter);
           state.scsi_error_counters[2].found=1;
       }
       if (state.NonMediumErrorPageSupported && (0 == scsiLogSense(scsidev,
-          NON_MEDIUM_ERROR_LPAGE, 0, tBuf, sizeof(tBuf), 0))) {
+          NON_MEDIUM_ERROR_LPAGE, 0, tBuf, sizeof(tBuf), 0))
+          && is_scsi_page_changed(state, 3, tBuf)) {
           scsiDecodeNonMediumErrPage(tBuf, &state.scsi_nonmedium_error.nme);
           state.scsi_nonmedium_error.found=1;
       }
     }
-    CloseDevice(scsidev, name);
+    CloseDeviceAfterCheck(state, scsidev, name);
     return 0;
 }
 
@@ -3497,7 +4418,7 @@ static int NVMeCheckDevice(const dev_config & cfg, dev_state & state, nvme_devic
   if (cfg.emailtest)
     MailWarning(cfg, state, 0, "TEST EMAIL from smartd for device: %s", name);
 
-  if (!nvmedev->open()) {
+  if (!OpenDevice(state, nvmedev)) {
     PrintOut(LOG_INFO, "Device: %s, open() failed: %s\n", name, nvmedev->get_errmsg());
     MailWarning(cfg, state, 9, "Device: %s, unable to open device", name);
     return 1;
@@ -3507,11 +4428,13 @@ static int NVMeCheckDevice(const dev_config & cfg, dev_state & state, nvme_devic
   reset_warning_mail(cfg, state, 9, "open device worked again");
 
   // Read SMART/Health log
+  state.timing.set_phase(PHASE_SMART);
   nvme_smart_log smart_log;
   if (!nvme_read_smart_log(nvmedev, smart_log)) {
       PrintOut(LOG_INFO, "Device: %s, failed to read NVMe SMART/Health Information\n", name);
       MailWarning(cfg, state, 6, "Device: %s, failed to read NVMe SMART/Health Information", name);
       state.must_write = true;
+      CloseDeviceAfterCheck(state, nvmedev, name);
       return 0;
   }
 
@@ -3567,7 +4490,7 @@ static int NVMeCheckDevice(const dev_config & cfg, dev_state & state, nvme_devic
     state.nvme_err_log_entries = newcnt;
   }
 
-  CloseDevice(nvmedev, name);
+  CloseDeviceAfterCheck(state, nvmedev, name);
   return 0;
 }
 
@@ -3649,20 +4572,72 @@ static void do_disable_standby_check(const dev_config_vector & configs, const de
   }
 }
 
+// Format duration in usec as milliseconds
+static std::string format_msec(int64_t usec)
+{
+  return strprintf("%" PRId64 ".%03d ms", usec / 1000, (int)(usec % 1000));
+}
+
+// Print duration of check phases if requested,
+// warn if a phase took longer than SLOW_PHASE_USEC
+static void report_check_timing(const dev_config & cfg, dev_state & state)
+{
+  const check_timing & t = state.timing;
+  int64_t total = 0;
+  int slowest = 0;
+  for (int i = 0; i < NUM_PHASES; i++) {
+    total += t.usec[i];
+    if (t.usec[slowest] < t.usec[i])
+      slowest = i;
+  }
+
+  // Always logged, at LOG_DEBUG unless requested
+  std::string msg;
+  for (int i = 0; i < NUM_PHASES; i++) {
+    if (t.usec[i])
+      msg += strprintf("%s %s, ", check_phase_names[i], format_msec(t.usec[i]).c_str());
+  }
+  PrintOut((debugmode || show_timing ? LOG_INFO : LOG_DEBUG),
+           "Device: %s, check time: %stotal %s\n", cfg.name.c_str(),
+           msg.c_str(), format_msec(total).c_str());
+
+  if (t.usec[slowest] > SLOW_PHASE_USEC) {
+    if (state.timing.slow_phase != slowest)
+      PrintOut(LOG_INFO, "Device: %s, slow device, %s phase took %s\n", cfg.name.c_str(),
+               check_phase_names[slowest], format_msec(t.usec[slowest]).c_str());
+    state.timing.slow_phase = slowest;
+  }
+  else if (state.timing.slow_phase >= 0) {
+    PrintOut(LOG_INFO, "Device: %s, check time is back to normal (%s)\n", cfg.name.c_str(),
+             format_msec(total).c_str());
+    state.timing.slow_phase = -1;
+  }
+}
+
 // Checks the SMART status of all ATA and SCSI devices
 static void CheckDevicesOnce(const dev_config_vector & configs, dev_state_vector & states,
                              smart_device_list & devices, bool firstpass, bool allow_selftests)
 {
+  // Count devices with surface scan chunk in progress
+  scan_group_busy.clear();
+  for (unsigned i = 0; i < configs.size(); i++) {
+    if (configs.at(i).scan_chunks && states.at(i).scan_running)
+      scan_group_busy[configs.at(i).scan_group]++;
+  }
+
   for (unsigned i = 0; i < configs.size(); i++) {
     const dev_config & cfg = configs.at(i);
     dev_state & state = states.at(i);
     smart_device * dev = devices.at(i);
+    state.timing.begin();
     if (dev->is_ata())
       ATACheckDevice(cfg, state, dev->to_ata(), firstpass, allow_selftests);
     else if (dev->is_scsi())
       SCSICheckDevice(cfg, state, dev->to_scsi(), allow_selftests);
     else if (dev->is_nvme())
       NVMeCheckDevice(cfg, state, dev->to_nvme());
+    state.timing.end();
+    report_check_timing(cfg, state);
   }
 
   do_disable_standby_check(configs, states);
@@ -3737,6 +4712,144 @@ static void ToggleDebugMode()
 }
 #endif
 
+/////////////////////////////////////////////////////////////////////////////
+// NVMe asynchronous event notification
+
+// Linux reports NVMe asynchronous events as uevents of the controller
+// with key NVME_AEN.  smartd listens for these while sleeping and checks
+// the devices of the affected controller immediately.
+
+#ifdef __linux__
+// Netlink socket for kernel uevents, -1 if not open
+static int nvme_aen_fd = -1;
+#endif
+
+// Names of controllers ("nvme0") which reported asynchronous events
+static std::vector<std::string> nvme_aen_ctrls;
+
+// Return controller name ("nvme0") of NVMe device "[/dev/]nvme0[nN]",
+// empty if unknown.
+static std::string get_nvme_ctrl_name(const char * name)
+{
+  const char * p = strrchr(name, '/');
+  p = (p ? p + 1 : name);
+  unsigned x = 0; int n = -1;
+  sscanf(p, "nvme%u%n", &x, &n);
+  if (n < 0)
+    return "";
+  return std::string(p, n);
+}
+
+// Start listening for NVMe asynchronous events if NVMe devices are monitored.
+// Must be called after DaemonInit() because it closes all file descriptors.
+static void nvme_aen_open(const smart_device_list & devices)
+{
+  bool have_nvme = false;
+  for (unsigned i = 0; i < devices.size() && !have_nvme; i++)
+    have_nvme = devices.at(i)->is_nvme();
+  if (!have_nvme)
+    return;
+
+#ifdef __linux__
+  if (nvme_aen_fd >= 0)
+    return;
+
+  int fd = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_KOBJECT_UEVENT);
+  if (fd >= 0) {
+    struct sockaddr_nl sa; memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    sa.nl_groups = 1; // kernel uevents
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+      int err = errno;
+      close(fd); fd = -1;
+      errno = err;
+    }
+  }
+  if (fd < 0) {
+    PrintOut(LOG_INFO, "NVMe asynchronous events not monitored: %s\n", strerror(errno));
+    return;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  nvme_aen_fd = fd;
+  if (debugmode)
+    PrintOut(LOG_INFO, "Monitoring NVMe asynchronous events\n");
+#endif
+}
+
+#ifdef __linux__
+// Read pending uevents, add controllers with NVME_AEN to nvme_aen_ctrls.
+static void nvme_aen_read_uevents()
+{
+  for (;;) {
+    char buf[4096];
+    struct sockaddr_nl sa; memset(&sa, 0, sizeof(sa));
+    socklen_t salen = sizeof(sa);
+    int n = recvfrom(nvme_aen_fd, buf, sizeof(buf) - 1, MSG_DONTWAIT,
+                     (struct sockaddr *)&sa, &salen);
+    if (n <= 0)
+      break;
+    if (sa.nl_pid != 0)
+      continue; // not sent by kernel
+    buf[n] = 0;
+
+    // "ACTION@DEVPATH" followed by "KEY=VALUE" strings, all '\0' terminated
+    const char * devname = 0, * aen = 0;
+    for (const char * p = buf; p < buf + n; p += strlen(p) + 1) {
+      if (str_starts_with(p, "DEVNAME="))
+        devname = p + 8;
+      else if (str_starts_with(p, "NVME_AEN="))
+        aen = p + 9;
+    }
+    if (!(devname && aen))
+      continue;
+
+    std::string ctrl = get_nvme_ctrl_name(devname);
+    if (ctrl.empty())
+      continue;
+    PrintOut(LOG_INFO, "NVMe controller %s reported asynchronous event %s\n",
+             ctrl.c_str(), aen);
+    if (std::find(nvme_aen_ctrls.begin(), nvme_aen_ctrls.end(), ctrl) == nvme_aen_ctrls.end())
+      nvme_aen_ctrls.push_back(ctrl);
+  }
+}
+#endif
+
+// Sleep SECONDS or until a signal or an NVMe asynchronous event arrives.
+static void sleep_or_wait_nvme_aen(int seconds)
+{
+#ifdef __linux__
+  if (nvme_aen_fd >= 0) {
+    fd_set rfds;
+    FD_ZERO(&rfds); FD_SET(nvme_aen_fd, &rfds);
+    struct timeval tv;
+    tv.tv_sec = seconds; tv.tv_usec = 0;
+    if (select(nvme_aen_fd + 1, &rfds, 0, 0, &tv) > 0)
+      nvme_aen_read_uevents();
+    return;
+  }
+#endif
+  sleep(seconds);
+}
+
+// Check the NVMe devices of all controllers in nvme_aen_ctrls.
+static void CheckNVMeAENDevices(const dev_config_vector & configs, dev_state_vector & states,
+                                smart_device_list & devices)
+{
+  for (unsigned i = 0; i < configs.size(); i++) {
+    smart_device * dev = devices.at(i);
+    if (!dev->is_nvme())
+      continue;
+    std::string ctrl = get_nvme_ctrl_name(dev->get_dev_name());
+    if (std::find(nvme_aen_ctrls.begin(), nvme_aen_ctrls.end(), ctrl) == nvme_aen_ctrls.end())
+      continue;
+    const dev_config & cfg = configs.at(i);
+    PrintOut(LOG_INFO, "Device: %s, checking device now after asynchronous event\n",
+             cfg.name.c_str());
+    NVMeCheckDevice(cfg, states.at(i), dev->to_nvme());
+  }
+  nvme_aen_ctrls.clear();
+}
+
 static time_t dosleep(time_t wakeuptime, bool & sigwakeup)
 {
   // If past wake-up-time, compute next wake-up-time
@@ -3748,7 +4861,8 @@ static time_t dosleep(time_t wakeuptime, bool & sigwakeup)
   
   // sleep until we catch SIGUSR1 or have completed sleeping
   int addtime = 0;
-  while (timenow < wakeuptime+addtime && !caughtsigUSR1 && !caughtsigHUP && !caughtsigEXIT) {
+  while (   timenow < wakeuptime+addtime && !caughtsigUSR1 && !caughtsigHUP && !caughtsigEXIT
+         && nvme_aen_ctrls.empty()) {
     
     // protect user again system clock being adjusted backwards
     if (wakeuptime>timenow+checktime){
@@ -3756,8 +4870,9 @@ static time_t dosleep(time_t wakeuptime, bool & sigwakeup)
       wakeuptime=timenow+checktime;
     }
     
-    // Exit sleep when time interval has expired or a signal is received
-    sleep(wakeuptime+addtime-timenow);
+    // Exit sleep when time interval has expired, a signal or
+    // an NVMe asynchronous event is received
+    sleep_or_wait_nvme_aen(wakeuptime+addtime-timenow);
 
 #ifdef _WIN32
     // toggle debug mode?
@@ -3834,6 +4949,9 @@ static void printoutvaliddirectiveargs(int priority, char d)
     PrintOut(priority, "aam,[N|off], apm,[N|off], lookahead,[on|off], "
                        "security-freeze, standby,[N|off], wcache,[on|off]");
     break;
+  case 'b':
+    PrintOut(priority, "N[,GROUP[,MAX]] (1 <= N <= 100000, 1 <= MAX <= 1000)");
+    break;
   }
 }
 
@@ -3973,6 +5091,31 @@ static int ParseToken(char * token, dev_config & cfg, smart_devtype_list & scan_
     cfg.offl_pending_incr = (*plus == '+');
     cfg.offl_pending_set = true;
     break;
+  case 'b':
+    // surface scan in N selective self-test chunks (ATA), optionally
+    // limited to MAX devices of GROUP scanning concurrently
+    if ((arg = strtok(NULL, delim)) == NULL) {
+      missingarg = 1;
+    } else {
+      char group[64+1] = "";
+      unsigned n = 0, max = 1; int n1 = -1, n2 = -1, n3 = -1, len = strlen(arg);
+      sscanf(arg, "%u%n,%64[^,]%n,%u%n", &n, &n1, group, &n2, &max, &n3);
+      if (   (n1 == len || n2 == len || n3 == len)
+          && 1 <= n && n <= 100000 && 1 <= max && max <= 1000) {
+        cfg.scan_chunks = n;
+        cfg.scan_group = group;
+        cfg.scan_group_max = max;
+      }
+      else
+        badarg = 1;
+    }
+    break;
+  case 'G':
+    // track grown defect list (SCSI), warn if grown by this per check
+    if ((val = GetInteger(arg=strtok(NULL,delim), name, token, lineno, configfile, 1, 65535)) < 0)
+      return -1;
+    cfg.grown_defects_warn = val;
+    break;
   case 'T':
     // Set tolerance level for SMART command failures
     if ((arg = strtok(NULL, delim)) == NULL) {
@@ -4058,6 +5201,31 @@ static int ParseToken(char * token, dev_config & cfg, smart_devtype_list & scan_
     } else if (!strcmp(arg, "selfteststs,ns")) {
       // track changes in self-test execution status, disable auto standby
       cfg.selfteststs = cfg.selfteststs_ns = true;
+    } else if (!strcmp(arg, "background")) {
+      // track new entries in background scan results log (SCSI)
+      cfg.backgroundlog = true;
+    } else if (!strcmp(arg, "sasphy")) {
+      // track SAS phy error counters, default warning limit
+      cfg.sasphy_warn = 10;
+    } else if (!strncmp(arg, "sasphy,", sizeof("sasphy,")-1)) {
+      // track SAS phy error counters, warn if increased by N per check
+      unsigned n = 0; int nc = -1;
+      sscanf(arg, "sasphy,%u%n", &n, &nc);
+      if (nc == (int)strlen(arg) && 1 <= n && n <= 1000000000)
+        cfg.sasphy_warn = n;
+      else
+        badarg = 1;
+    } else if (!strcmp(arg, "scttemp")) {
+      // merge SCT temperature history, read hourly
+      cfg.scttemp_interval = 60;
+    } else if (!strncmp(arg, "scttemp,", sizeof("scttemp,")-1)) {
+      // merge SCT temperature history, read every N minutes
+      unsigned n = 0; int nc = -1;
+      sscanf(arg, "scttemp,%u%n", &n, &nc);
+      if (nc == (int)strlen(arg) && 10 <= n && n <= 1440)
+        cfg.scttemp_interval = n;
+      else
+        badarg = 1;
     } else if (!strncmp(arg, "scterc,", sizeof("scterc,")-1)) {
         // set SCT Error Recovery Control
         unsigned rt = ~0, wt = ~0; int nc = -1;
@@ -4681,7 +5849,7 @@ static void ParseOpts(int argc, char **argv)
 #endif
 
   // Please update GetValidArgList() if you edit shortopts
-  static const char shortopts[] = "c:l:q:dDni:p:r:s:A:B:w:Vh?"
+  static const char shortopts[] = "c:l:q:dDni:k:p:r:R:s:A:B:t:w:Vh?"
 #ifdef HAVE_LIBCAP_NG
                                                           "C"
 #endif
@@ -4694,6 +5862,7 @@ static void ParseOpts(int argc, char **argv)
     { "debug",          no_argument,       0, 'd' },
     { "showdirectives", no_argument,       0, 'D' },
     { "interval",       required_argument, 0, 'i' },
+    { "keepopen",       required_argument, 0, 'k' },
 #ifndef _WIN32
     { "no-fork",        no_argument,       0, 'n' },
 #else
@@ -4701,9 +5870,11 @@ static void ParseOpts(int argc, char **argv)
 #endif
     { "pidfile",        required_argument, 0, 'p' },
     { "report",         required_argument, 0, 'r' },
+    { "record",         required_argument, 0, 'R' },
     { "savestates",     required_argument, 0, 's' },
     { "attributelog",   required_argument, 0, 'A' },
     { "drivedb",        required_argument, 0, 'B' },
+    { "typecache",      required_argument, 0, 't' },
     { "warnexec",       required_argument, 0, 'w' },
     { "version",        no_argument,       0, 'V' },
     { "license",        no_argument,       0, 'V' },
@@ -4742,6 +5913,10 @@ static void ParseOpts(int argc, char **argv)
       } else if (!(strcmp(optarg,"showtests"))) {
         quit=4;
         debugmode=1;
+      } else if (!(strcmp(optarg,"showtiming"))) {
+        quit=3;
+        debugmode=1;
+        show_timing = true;
       } else if (!(strcmp(optarg,"errors"))) {
         quit=5;
       } else {
@@ -4802,6 +5977,17 @@ static void ParseOpts(int argc, char **argv)
       }
       checktime = (int)lchecktime;
       break;
+    case 'k':
+      // Max time to keep devices open between checks
+      {
+        errno = 0;
+        long t = strtol(optarg, &tailptr, 10);
+        if (*tailptr != '\0' || t < 0 || t > INT_MAX || errno)
+          badarg = true;
+        else
+          keepopen_time = (int)t;
+      }
+      break;
     case 'r':
       // report IOCTL transactions
       {
@@ -4842,6 +6028,14 @@ static void ParseOpts(int argc, char **argv)
       // path prefix of attribute log file
       attrlog_path_prefix = optarg;
       break;
+    case 'R':
+      // path prefix of recorded response files
+      record_path_prefix = optarg;
+      break;
+    case 't':
+      // cache file for device type autodetection
+      smi()->set_type_cache_file(optarg);
+      break;
     case 'B':
       {
         const char * path = optarg;
@@ -5169,6 +6363,11 @@ static void RegisterDevices(const dev_config_vector & conf_entries, smart_device
       PrintOut(LOG_INFO,"Device: %s, type changed from '%s' to '%s'\n",
         cfg.name.c_str(), oldinfo.dev_type.c_str(), dev->get_dev_type());
 
+    // Save result of autodetection if '-t FILE' is specified
+    if (cfg.dev_type.empty() && !smi()->update_type_cache(dev.get()))
+      PrintOut(LOG_INFO, "Device: %s, unable to write type cache file: %s\n",
+               cfg.name.c_str(), strerror(errno));
+
     if (!dev->is_open()) {
       // For linux+devfs, a nonexistent device gives a strange error
       // message.  This makes the error message a bit more sensible.
@@ -5182,6 +6381,21 @@ static void RegisterDevices(const dev_config_vector & conf_entries, smart_device
     cfg.name = dev->get_info().info_name;
     PrintOut(LOG_INFO, "Device: %s, opened\n", cfg.name.c_str());
 
+    // Record responses for '-d sim' if requested
+    if (!record_path_prefix.empty()) {
+      std::string path = record_path_prefix;
+      for (const char * p = cfg.name.c_str(); *p; p++)
+        path += (isalnum((unsigned char)*p) || *p == '-' ? *p : '_');
+      path += ".sim";
+      smart_device * recdev = get_sim_recorder(smi(), dev.get(), path.c_str());
+      if (recdev) {
+        dev.replace(recdev);
+        PrintOut(LOG_INFO, "Device: %s, recording responses to \"%s\"\n", cfg.name.c_str(), path.c_str());
+      }
+      else
+        PrintOut(LOG_INFO, "Device: %s, unable to record responses: %s\n", cfg.name.c_str(), smi()->get_errmsg());
+    }
+
     // Prepare initial state
     dev_state state;
 
@@ -5201,7 +6415,10 @@ static void RegisterDevices(const dev_config_vector & conf_entries, smart_device
     }
     // or register NVMe devices
     else if (dev->is_nvme()) {
-      if (NVMeDeviceScan(cfg, state, dev->to_nvme())) {
+      int status = NVMeDeviceScan(cfg, state, dev->to_nvme(), configs);
+      if (status == 4)
+        continue; // controller already registered
+      if (status) {
         CanNotRegister(cfg.name.c_str(), "NVMe", cfg.lineno, scanning);
         dev.reset();
       }
@@ -5375,26 +6592,43 @@ static int main_worker(int argc, char **argv)
 
     // check all devices once,
     // self tests are not started in first pass unless '-q onecheck' is specified
+    int64_t cycle_start = smi()->get_timer_usec();
     CheckDevicesOnce(configs, states, devices, firstpass, (!firstpass || quit==3));
+    int64_t check_end = smi()->get_timer_usec();
 
      // Write state files
     if (!state_path_prefix.empty())
       write_all_dev_states(configs, states, write_states_always);
     write_states_always = false;
+    int64_t states_end = smi()->get_timer_usec();
 
     // Write attribute logs
     if (!attrlog_path_prefix.empty())
       write_all_dev_attrlogs(configs, states);
+    int64_t cycle_end = smi()->get_timer_usec();
+
+    PrintOut((debugmode || show_timing ? LOG_INFO : LOG_DEBUG),
+             "Check cycle time: devices %s, state files %s, attribute logs %s, total %s\n",
+             format_msec(check_end - cycle_start).c_str(),
+             format_msec(states_end - check_end).c_str(),
+             format_msec(cycle_end - states_end).c_str(),
+             format_msec(cycle_end - cycle_start).c_str());
 
     // user has asked us to exit after first check
     if (quit==3) {
-      PrintOut(LOG_INFO,"Started with '-q onecheck' option. All devices sucessfully checked once.\n"
-               "smartd is exiting (exit status 0)\n");
+      PrintOut(LOG_INFO,"Started with '-q %s' option. All devices sucessfully checked once.\n"
+               "smartd is exiting (exit status 0)\n", (show_timing ? "showtiming" : "onecheck"));
       return 0;
     }
     
     // fork into background if needed
     if (firstpass && !debugmode) {
+      // DaemonInit() closes all file descriptors,
+      // devices kept open by '-k N' are reopened by the next check
+      for (unsigned i = 0; i < devices.size(); i++) {
+        if (devices.at(i)->is_open())
+          CloseDevice(devices.at(i), configs.at(i).name.c_str());
+      }
       DaemonInit();
     }
 
@@ -5404,8 +6638,15 @@ static int main_worker(int argc, char **argv)
       firstpass = false;
     }
     
-    // sleep until next check time, or a signal arrives
-    wakeuptime = dosleep(wakeuptime, write_states_always);
+    // sleep until next check time, or a signal arrives,
+    // check NVMe devices which reported asynchronous events meanwhile
+    nvme_aen_open(devices);
+    for (;;) {
+      wakeuptime = dosleep(wakeuptime, write_states_always);
+      if (nvme_aen_ctrls.empty())
+        break;
+      CheckNVMeAENDevices(configs, states, devices);
+    }
   }
 }
 
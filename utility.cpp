@@ -43,7 +43,10 @@
 #include <mbstring.h> // _mbsinc()
 #endif
 
+#include <algorithm> // std::fill(), std::sort(), std::unique()
+#include <map>
 #include <stdexcept>
+#include <vector>
 
 #include "svnversion.h"
 #include "int64.h"
@@ -429,16 +432,670 @@ static const char * check_regex(const char * pattern)
   return (const char *)0;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// Fast matcher for regular_expression
+
+// Supports the subset of POSIX ERE used by the drive database and smartd:
+// literals, escaped characters, '.', bracket expressions with ranges and
+// character classes, '^', '$', grouping, alternation and the repetitions
+// '*', '+', '?', '{M}', '{M,}' and '{M,N}'.
+// The pattern is compiled into a small NFA program which is run with all
+// threads in parallel (Thompson), so match time is linear in the string
+// length and no backtracking occurs.  If a program is used repeatedly,
+// the sets of threads are cached as states of a DFA which is built on
+// demand.  Unsupported patterns and strings with non-ASCII characters
+// are left to regcomp()/regexec().
+
+class regex_fast_program
+{
+public:
+  // Compile pattern, return 0 if pattern is not supported.
+  static regex_fast_program * create(const char * pattern);
+
+  // Return 1 on (full) match, 0 on mismatch, -1 if string is not supported.
+  int match(const char * str, bool full) const;
+
+  void add_ref()
+    { m_refcnt++; }
+  void release()
+    { if (!--m_refcnt) delete this; }
+
+private:
+  regex_fast_program();
+
+  enum op_type { OP_CHAR, OP_ANY, OP_SET, OP_BOL, OP_EOL, OP_SPLIT, OP_JMP, OP_MATCH };
+  struct inst {
+    op_type op;
+    int x, y; // OP_CHAR: char, OP_SET: set index, OP_SPLIT, OP_JMP: targets
+  };
+
+  struct charset {
+    unsigned char bits[256/8];
+    charset()
+      { memset(bits, 0, sizeof(bits)); }
+    bool test(unsigned char c) const
+      { return !!(bits[c >> 3] & (1 << (c & 7))); }
+    void set(unsigned char c)
+      { bits[c >> 3] |= (unsigned char)(1 << (c & 7)); }
+  };
+
+  // Parse tree
+  enum node_type { N_CHAR, N_ANY, N_SET, N_BOL, N_EOL, N_CAT, N_ALT, N_REP };
+  struct node {
+    node_type type;
+    int val;            // N_CHAR: char, N_SET: set index
+    int min, max;       // N_REP: bounds, max < 0 if unlimited
+    int first, last;    // N_CAT, N_ALT, N_REP: list of kids, -1 if empty
+    int next;           // Next kid of parent, -1 if none
+  };
+
+  // DFA state: set of threads before following jumps and assertions
+  struct dfa_state {
+    std::vector<int> pcs;       // Sorted
+    bool at_begin;              // Start state
+    short next[0x80];           // Next state for each char, -1 if unknown
+    signed char accept[2];      // Match if not at end / at end, -1 if unknown
+  };
+
+  enum { max_depth = 32, max_bound = 255, max_prog_size = 4096,
+         max_dfa_states = 256, min_dfa_use = 4 };
+
+  std::vector<inst> m_prog;
+  std::vector<charset> m_sets;
+  int m_refcnt;
+
+  // Parser state, only used by create()
+  const char * m_pos;
+  std::vector<node> m_nodes;
+
+  // Thread lists, stack and marks used by match(), allocated on first use
+  struct thread_list {
+    int * pcs;
+    unsigned size;
+  };
+  mutable std::vector<int> m_scratch;
+  mutable int * m_list[2];
+  mutable int * m_stack;
+  mutable unsigned * m_mark;
+  mutable unsigned m_gen;
+
+  // DFA states for substring [0] and full [1] match, built on demand
+  mutable std::vector<dfa_state> m_dfa[2];
+  mutable std::map<std::vector<int>, int> m_dfa_index[2];
+  mutable unsigned m_use_count;
+
+  int add_node(node_type type, int val = 0);
+  void add_kid(int parent, int kid);
+  int parse_alt(int depth);
+  int parse_cat(int depth);
+  int parse_atom(int depth);
+  bool parse_bracket(charset & cs);
+  int add_inst(op_type op, int x = 0);
+  bool emit(int n);
+  void next_gen() const;
+  bool add_thread(thread_list & list, int pc, bool at_begin, bool at_end,
+                  bool full) const;
+  bool step(int pc, unsigned char c) const;
+  int nfa_match(const char * str, bool full) const;
+  bool dfa_closure(const dfa_state & st, thread_list & list, bool at_end,
+                   bool full) const;
+  int dfa_add_state(bool full, std::vector<int> & pcs, bool at_begin) const;
+  int dfa_match(const char * str, bool full) const;
+};
+
+regex_fast_program::regex_fast_program()
+: m_refcnt(1), m_pos(0), m_stack(0), m_mark(0), m_gen(0), m_use_count(0)
+{
+  m_list[0] = m_list[1] = 0;
+}
+
+int regex_fast_program::add_node(node_type type, int val /* = 0 */)
+{
+  node nd = { type, val, 0, 0, -1, -1, -1 };
+  m_nodes.push_back(nd);
+  return (int)m_nodes.size() - 1;
+}
+
+void regex_fast_program::add_kid(int parent, int kid)
+{
+  node & p = m_nodes[parent];
+  if (p.last >= 0)
+    m_nodes[p.last].next = kid;
+  else
+    p.first = kid;
+  p.last = kid;
+}
+
+// ALT: CAT ['|' CAT]...
+int regex_fast_program::parse_alt(int depth)
+{
+  int n = parse_cat(depth);
+  if (n < 0 || *m_pos != '|')
+    return n;
+  int alt = add_node(N_ALT);
+  add_kid(alt, n);
+  while (*m_pos == '|') {
+    m_pos++;
+    if ((n = parse_cat(depth)) < 0)
+      return -1;
+    add_kid(alt, n);
+  }
+  return alt;
+}
+
+// CAT: ATOM[REPEAT]...
+int regex_fast_program::parse_cat(int depth)
+{
+  int cat = add_node(N_CAT);
+  for (;;) {
+    char c = *m_pos;
+    if (!c || c == '|' || c == ')')
+      break;
+    int n = parse_atom(depth);
+    if (n < 0)
+      return -1;
+    for (;;) {
+      int min, max;
+      c = *m_pos;
+      if (c == '*') {
+        min = 0; max = -1; m_pos++;
+      }
+      else if (c == '+') {
+        min = 1; max = -1; m_pos++;
+      }
+      else if (c == '?') {
+        min = 0; max = 1; m_pos++;
+      }
+      else if (c == '{') {
+        // {M}, {M,}, {M,N}, check bounds before cast to int
+        char * end;
+        if (!isdigit((unsigned char)*++m_pos))
+          return -1;
+        unsigned long val = strtoul(m_pos, &end, 10);
+        if (val > max_bound)
+          return -1;
+        min = max = (int)val;
+        m_pos = end;
+        if (*m_pos == ',') {
+          if (isdigit((unsigned char)*++m_pos)) {
+            val = strtoul(m_pos, &end, 10);
+            if (val > max_bound)
+              return -1;
+            max = (int)val;
+            m_pos = end;
+          }
+          else
+            max = -1;
+        }
+        if (*m_pos++ != '}')
+          return -1;
+        if (!(max < 0 || min <= max))
+          return -1;
+      }
+      else
+        break;
+      // Repeated anchors are handled differently by regex libraries
+      if (m_nodes[n].type == N_BOL || m_nodes[n].type == N_EOL)
+        return -1;
+      int rep = add_node(N_REP);
+      m_nodes[rep].min = min; m_nodes[rep].max = max;
+      add_kid(rep, n);
+      n = rep;
+    }
+    add_kid(cat, n);
+  }
+  // Empty subexpressions are not portable
+  if (m_nodes[cat].first < 0)
+    return -1;
+  return cat;
+}
+
+int regex_fast_program::parse_atom(int depth)
+{
+  unsigned char c = *m_pos++;
+  switch (c) {
+    case '(': {
+      if (depth >= max_depth)
+        return -1;
+      int n = parse_alt(depth + 1);
+      if (n < 0 || *m_pos != ')')
+        return -1;
+      m_pos++;
+      return n;
+    }
+    case '.':
+      return add_node(N_ANY);
+    case '^':
+      return add_node(N_BOL);
+    case '$':
+      return add_node(N_EOL);
+    case '[': {
+      charset cs;
+      if (!parse_bracket(cs))
+        return -1;
+      m_sets.push_back(cs);
+      return add_node(N_SET, (int)m_sets.size() - 1);
+    }
+    case '*': case '+': case '?': case '{':
+      return -1;
+    case '\\':
+      // Back references and GNU extensions (\w, \<, ...) are not supported
+      c = *m_pos++;
+      if (!c || isalnum(c) || strchr("<>`'", c))
+        return -1;
+      break;
+  }
+  if (c >= 0x80)
+    return -1;
+  return add_node(N_CHAR, c);
+}
+
+// Parse bracket expression after '['.
+bool regex_fast_program::parse_bracket(charset & cs)
+{
+  static const struct {
+    const char * name;
+    int (* func)(int);
+  } classes[] = {
+    { "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank },
+    { "cntrl", iscntrl }, { "digit", isdigit }, { "graph", isgraph },
+    { "lower", islower }, { "print", isprint }, { "punct", ispunct },
+    { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit }
+  };
+
+  bool negate = (*m_pos == '^');
+  if (negate)
+    m_pos++;
+
+  for (bool first = true; ; first = false) {
+    unsigned char c = *m_pos++;
+    if (!c || c >= 0x80)
+      return false;
+    if (c == ']' && !first)
+      break;
+    if (c == '[') {
+      char t = *m_pos;
+      if (t == '.' || t == '=') // Collating elements and equivalence classes
+        return false;
+      if (t == ':') {
+        const char * end = strstr(m_pos + 1, ":]");
+        if (!end)
+          return false;
+        const char * name = m_pos + 1;
+        unsigned len = end - name;
+        m_pos = end + 2;
+        unsigned i;
+        for (i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+          if (len == strlen(classes[i].name) && !strncmp(name, classes[i].name, len))
+            break;
+        }
+        if (i >= sizeof(classes) / sizeof(classes[0]))
+          return false;
+        for (int j = 1; j < 0x80; j++) {
+          if (classes[i].func(j))
+            cs.set(j);
+        }
+        // Class as range endpoint
+        if (*m_pos == '-' && m_pos[1] != ']')
+          return false;
+        continue;
+      }
+    }
+    unsigned char last = c;
+    if (*m_pos == '-' && m_pos[1] && m_pos[1] != ']') {
+      last = m_pos[1];
+      m_pos += 2;
+      if (last == '[' || last >= 0x80 || last < c)
+        return false;
+    }
+    for (unsigned i = c; i <= last; i++)
+      cs.set(i);
+  }
+
+  if (negate) {
+    for (unsigned i = 0; i < sizeof(cs.bits); i++)
+      cs.bits[i] = ~cs.bits[i];
+  }
+  return true;
+}
+
+int regex_fast_program::add_inst(op_type op, int x /* = 0 */)
+{
+  inst in = { op, x, 0 };
+  m_prog.push_back(in);
+  return (int)m_prog.size() - 1;
+}
+
+// Append code for parse tree node N, return false if program is too large.
+bool regex_fast_program::emit(int n)
+{
+  if (m_prog.size() > max_prog_size)
+    return false;
+  const node & nd = m_nodes[n];
+  switch (nd.type) {
+    case N_CHAR: add_inst(OP_CHAR, nd.val); break;
+    case N_ANY:  add_inst(OP_ANY); break;
+    case N_SET:  add_inst(OP_SET, nd.val); break;
+    case N_BOL:  add_inst(OP_BOL); break;
+    case N_EOL:  add_inst(OP_EOL); break;
+
+    case N_CAT:
+      for (int k = nd.first; k >= 0; k = m_nodes[k].next) {
+        if (!emit(k))
+          return false;
+      }
+      break;
+
+    case N_ALT: {
+      // SPLIT L1, L2; L1: KID1; JMP END; L2: SPLIT ...; LN: KIDN; END:
+      // The JMPs are chained through their targets until END is known.
+      int jumps = -1;
+      for (int k = nd.first; k >= 0; k = m_nodes[k].next) {
+        int split = -1;
+        if (m_nodes[k].next >= 0) {
+          split = add_inst(OP_SPLIT);
+          m_prog[split].x = split + 1;
+        }
+        if (!emit(k))
+          return false;
+        if (split >= 0) {
+          jumps = add_inst(OP_JMP, jumps);
+          m_prog[split].y = (int)m_prog.size();
+        }
+      }
+      while (jumps >= 0) {
+        int prev = m_prog[jumps].x;
+        m_prog[jumps].x = (int)m_prog.size();
+        jumps = prev;
+      }
+      break;
+    }
+
+    case N_REP: {
+      int i;
+      for (i = 0; i < nd.min; i++) {
+        if (!emit(nd.first))
+          return false;
+      }
+      if (nd.max < 0) {
+        // L: SPLIT L1, END; L1: KID; JMP L; END:
+        int split = add_inst(OP_SPLIT);
+        m_prog[split].x = split + 1;
+        if (!emit(nd.first))
+          return false;
+        add_inst(OP_JMP, split);
+        m_prog[split].y = (int)m_prog.size();
+      }
+      else {
+        // SPLIT L1, END; L1: KID; SPLIT L2, END; L2: KID; ... END:
+        // The SPLITs are chained through their second targets.
+        int splits = -1;
+        for ( ; i < nd.max; i++) {
+          int split = add_inst(OP_SPLIT);
+          m_prog[split].x = split + 1;
+          m_prog[split].y = splits;
+          splits = split;
+          if (!emit(nd.first))
+            return false;
+        }
+        while (splits >= 0) {
+          int prev = m_prog[splits].y;
+          m_prog[splits].y = (int)m_prog.size();
+          splits = prev;
+        }
+      }
+      break;
+    }
+  }
+  return true;
+}
+
+regex_fast_program * regex_fast_program::create(const char * pattern)
+{
+  regex_fast_program * prog = new regex_fast_program;
+  prog->m_pos = pattern;
+  // Reserve upper bounds, repetitions with bounds may need more
+  unsigned len = strlen(pattern), sets = 0;
+  for (const char * p = pattern; *p; p++)
+    sets += (*p == '[');
+  prog->m_nodes.reserve(2 * len + 2);
+  prog->m_prog.reserve(3 * len + 2);
+  prog->m_sets.reserve(sets);
+  int root = prog->parse_alt(0);
+  if (!(root >= 0 && !*prog->m_pos && prog->emit(root))) {
+    delete prog;
+    return 0;
+  }
+  prog->add_inst(OP_MATCH);
+
+  // Parse tree is no longer needed
+  std::vector<node>().swap(prog->m_nodes);
+  prog->m_pos = 0;
+  return prog;
+}
+
+void regex_fast_program::next_gen() const
+{
+  if (!++m_gen) {
+    memset(m_mark, 0, m_prog.size() * sizeof(*m_mark));
+    m_gen = 1;
+  }
+}
+
+// Add thread at PC and all threads reachable without consuming a char
+// to LIST, return true if a match is reached.
+bool regex_fast_program::add_thread(thread_list & list, int pc, bool at_begin,
+                                    bool at_end, bool full) const
+{
+  int * stack = m_stack;
+  int sp = 0;
+  stack[sp++] = pc;
+  while (sp > 0) {
+    pc = stack[--sp];
+    if (m_mark[pc] == m_gen)
+      continue;
+    m_mark[pc] = m_gen;
+    const inst & in = m_prog[pc];
+    switch (in.op) {
+      case OP_JMP:
+        stack[sp++] = in.x;
+        break;
+      case OP_SPLIT:
+        stack[sp++] = in.y;
+        stack[sp++] = in.x;
+        break;
+      case OP_BOL:
+        if (at_begin)
+          stack[sp++] = pc + 1;
+        break;
+      case OP_EOL:
+        if (at_end)
+          stack[sp++] = pc + 1;
+        break;
+      case OP_MATCH:
+        if (!full || at_end)
+          return true;
+        break;
+      default:
+        list.pcs[list.size++] = pc;
+        break;
+    }
+  }
+  return false;
+}
+
+// Return true if the thread at PC consumes char C.
+inline bool regex_fast_program::step(int pc, unsigned char c) const
+{
+  const inst & in = m_prog[pc];
+  switch (in.op) {
+    case OP_CHAR: return (c == in.x);
+    case OP_ANY:  return true;
+    case OP_SET:  return m_sets[in.x].test(c);
+    default:      return false;
+  }
+}
+
+int regex_fast_program::nfa_match(const char * str, bool full) const
+{
+  thread_list clist = { m_list[0], 0 }, nlist = { m_list[1], 0 };
+  next_gen();
+  if (add_thread(clist, 0, true, !*str, full))
+    return 1;
+
+  for (const char * p = str; *p; p++) {
+    unsigned char c = *p;
+    if (c >= 0x80) // Result may depend on locale
+      return -1;
+    nlist.size = 0;
+    next_gen();
+    bool at_end = !p[1];
+    for (unsigned i = 0; i < clist.size; i++) {
+      int pc = clist.pcs[i];
+      if (step(pc, c) && add_thread(nlist, pc + 1, false, at_end, full))
+        return 1;
+    }
+    if (!full) {
+      // Substring match: start new thread at each position
+      if (add_thread(nlist, 0, false, at_end, full))
+        return 1;
+    }
+    else if (!nlist.size)
+      return 0;
+    std::swap(clist, nlist);
+  }
+  return 0;
+}
+
+// Compute threads of state ST in LIST, return true if a match is reached.
+bool regex_fast_program::dfa_closure(const dfa_state & st, thread_list & list,
+                                     bool at_end, bool full) const
+{
+  list.size = 0;
+  next_gen();
+  bool matched = false;
+  for (unsigned i = 0; i < st.pcs.size(); i++) {
+    if (add_thread(list, st.pcs[i], st.at_begin, at_end, full))
+      matched = true;
+  }
+  // Substring match: start new thread at each position
+  if (!full && !st.at_begin && add_thread(list, 0, false, at_end, full))
+    matched = true;
+  return matched;
+}
+
+// Find or add state with sorted thread set PCS, return -1 if cache is full.
+int regex_fast_program::dfa_add_state(bool full, std::vector<int> & pcs, bool at_begin) const
+{
+  std::vector<dfa_state> & states = m_dfa[full];
+  if (at_begin)
+    pcs.push_back(-1); // Start state has a separate key
+  std::map<std::vector<int>, int>::const_iterator it = m_dfa_index[full].find(pcs);
+  int s;
+  if (it != m_dfa_index[full].end())
+    s = it->second;
+  else if (states.size() >= max_dfa_states)
+    s = -1;
+  else {
+    s = (int)states.size();
+    m_dfa_index[full][pcs] = s;
+    states.push_back(dfa_state());
+    dfa_state & st = states.back();
+    st.pcs = pcs;
+    if (at_begin)
+      st.pcs.pop_back();
+    st.at_begin = at_begin;
+    memset(st.next, 0xff, sizeof(st.next));
+    st.accept[0] = st.accept[1] = -1;
+  }
+  if (at_begin)
+    pcs.pop_back();
+  return s;
+}
+
+// Return 1 on (full) match, 0 on mismatch, -1 if string or size not supported.
+int regex_fast_program::dfa_match(const char * str, bool full) const
+{
+  std::vector<dfa_state> & states = m_dfa[full];
+  int s;
+  if (states.empty()) {
+    std::vector<int> start(1, 0);
+    s = dfa_add_state(full, start, true);
+  }
+  else
+    s = 0;
+
+  thread_list list = { m_list[0], 0 };
+  for (const char * p = str; ; p++) {
+    unsigned char c = *p;
+    if (c >= 0x80)
+      return -1;
+    bool at_end = !c;
+    signed char & acc = states[s].accept[at_end];
+    if (acc < 0)
+      acc = dfa_closure(states[s], list, at_end, full);
+    if (acc && (at_end || !full))
+      return 1;
+    if (at_end)
+      return 0;
+
+    int n = states[s].next[c];
+    if (n < 0) {
+      // Compute new state from threads which consume the char
+      dfa_closure(states[s], list, false, full);
+      std::vector<int> pcs;
+      for (unsigned i = 0; i < list.size; i++) {
+        if (step(list.pcs[i], c))
+          pcs.push_back(list.pcs[i] + 1);
+      }
+      std::sort(pcs.begin(), pcs.end());
+      pcs.erase(std::unique(pcs.begin(), pcs.end()), pcs.end());
+      if ((n = dfa_add_state(full, pcs, false)) < 0)
+        return -1;
+      states[s].next[c] = (short)n;
+    }
+    s = n;
+    // No threads left
+    if (full && states[s].pcs.empty())
+      return 0;
+  }
+}
+
+int regex_fast_program::match(const char * str, bool full) const
+{
+  if (m_scratch.empty()) {
+    // Thread lists, stack and marks
+    unsigned size = m_prog.size();
+    m_scratch.resize(2 * size + (2 * size + 1) + size);
+    m_list[0] = &m_scratch[0];
+    m_list[1] = m_list[0] + size;
+    m_stack = m_list[1] + size;
+    m_mark = (unsigned *)(m_stack + 2 * size + 1);
+  }
+
+  // Build DFA only if program is used repeatedly
+  if (m_use_count < min_dfa_use) {
+    m_use_count++;
+    return nfa_match(str, full);
+  }
+  int r = dfa_match(str, full);
+  if (r < 0)
+    r = nfa_match(str, full);
+  return r;
+}
+
 // Wrapper class for regex(3)
 
 regular_expression::regular_expression()
-: m_flags(0)
+: m_flags(0),
+  m_prog(0)
 {
   memset(&m_regex_buf, 0, sizeof(m_regex_buf));
 }
 
 regular_expression::regular_expression(const char * pattern, int flags,
                                        bool throw_on_error /*= true*/)
+: m_prog(0)
 {
   memset(&m_regex_buf, 0, sizeof(m_regex_buf));
   if (!compile(pattern, flags) && throw_on_error)
@@ -453,6 +1110,7 @@ regular_expression::~regular_expression()
 }
 
 regular_expression::regular_expression(const regular_expression & x)
+: m_prog(0)
 {
   memset(&m_regex_buf, 0, sizeof(m_regex_buf));
   copy(x);
@@ -460,6 +1118,8 @@ regular_expression::regular_expression(const regular_expression & x)
 
 regular_expression & regular_expression::operator=(const regular_expression & x)
 {
+  if (this == &x)
+    return *this;
   free_buf();
   copy(x);
   return *this;
@@ -471,6 +1131,10 @@ void regular_expression::free_buf()
     regfree(&m_regex_buf);
     memset(&m_regex_buf, 0, sizeof(m_regex_buf));
   }
+  if (m_prog) {
+    m_prog->release();
+    m_prog = 0;
+  }
 }
 
 void regular_expression::copy(const regular_expression & x)
@@ -480,8 +1144,13 @@ void regular_expression::copy(const regular_expression & x)
   m_errmsg = x.m_errmsg;
 
   if (!m_pattern.empty() && m_errmsg.empty()) {
+    // Share the compiled program of the fast matcher.
+    if (x.m_prog) {
+      m_prog = x.m_prog;
+      m_prog->add_ref();
+    }
     // There is no POSIX compiled-regex-copy command.
-    if (!compile())
+    else if (!compile())
       throw std::runtime_error(strprintf(
         "Unable to recompile regular expression \"%s\": %s",
         m_pattern.c_str(), m_errmsg.c_str()));
@@ -498,13 +1167,20 @@ bool regular_expression::compile(const char * pattern, int flags)
 
 bool regular_expression::compile()
 {
-  int errcode = regcomp(&m_regex_buf, m_pattern.c_str(), m_flags);
-  if (errcode) {
-    char errmsg[512];
-    regerror(errcode, &m_regex_buf, errmsg, sizeof(errmsg));
-    m_errmsg = errmsg;
-    free_buf();
-    return false;
+  // Use the fast matcher if the pattern is supported,
+  // regcomp() is then only called if regexec() is needed.
+  if (m_flags == REG_EXTENDED)
+    m_prog = regex_fast_program::create(m_pattern.c_str());
+
+  if (!m_prog) {
+    int errcode = regcomp(&m_regex_buf, m_pattern.c_str(), m_flags);
+    if (errcode) {
+      char errmsg[512];
+      regerror(errcode, &m_regex_buf, errmsg, sizeof(errmsg));
+      m_errmsg = errmsg;
+      free_buf();
+      return false;
+    }
   }
 
   const char * errmsg = check_regex(m_pattern.c_str());
@@ -518,6 +1194,57 @@ bool regular_expression::compile()
   return true;
 }
 
+// Compile POSIX regex on demand if the fast matcher is used.
+bool regular_expression::compile_posix() const
+{
+  if (!m_prog || nonempty(&m_regex_buf, sizeof(m_regex_buf)))
+    return true;
+  if (regcomp(&m_regex_buf, m_pattern.c_str(), m_flags)) {
+    memset(&m_regex_buf, 0, sizeof(m_regex_buf));
+    return false;
+  }
+  return true;
+}
+
+bool regular_expression::match(const char * str, int flags /* = 0 */) const
+{
+  if (m_prog && !flags) {
+    int r = m_prog->match(str, false);
+    if (r >= 0)
+      return !!r;
+  }
+  if (!compile_posix())
+    return false;
+  return !regexec(&m_regex_buf, str, 0, (regmatch_t*)0, flags);
+}
+
+bool regular_expression::full_match(const char * str, int flags /* = 0 */) const
+{
+  if (m_prog && !flags) {
+    int r = m_prog->match(str, true);
+    if (r >= 0)
+      return !!r;
+  }
+  if (!compile_posix())
+    return false;
+  regmatch_t range;
+  return (   !regexec(&m_regex_buf, str, 1, &range, flags)
+          && range.rm_so == 0 && range.rm_eo == (int)strlen(str));
+}
+
+bool regular_expression::execute(const char * str, unsigned nmatch, regmatch_t * pmatch,
+                                 int flags /* = 0 */) const
+{
+  if (m_prog && !nmatch && !flags) {
+    int r = m_prog->match(str, false);
+    if (r >= 0)
+      return !!r;
+  }
+  if (!compile_posix())
+    return false;
+  return !regexec(&m_regex_buf, str, nmatch, pmatch, flags);
+}
+
 #ifndef HAVE_STRTOULL
 // Replacement for missing strtoull() (Linux with libc < 6, MSVC)
 // Functionality reduced to requirements of smartd and split_selective_arg().
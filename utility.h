@@ -227,6 +227,8 @@ private:
   void operator=(const stdio_file &);
 };
 
+class regex_fast_program;
+
 /// Wrapper class for regex(3).
 /// Supports copy & assignment and is compatible with STL containers.
 class regular_expression
@@ -260,30 +262,25 @@ public:
     { return (m_pattern.empty() || !m_errmsg.empty()); }
 
   /// Return true if substring matches pattern
-  bool match(const char * str, int flags = 0) const
-    { return !regexec(&m_regex_buf, str, 0, (regmatch_t*)0, flags); }
+  bool match(const char * str, int flags = 0) const;
 
   /// Return true if full string matches pattern
-  bool full_match(const char * str, int flags = 0) const
-    {
-      regmatch_t range;
-      return (   !regexec(&m_regex_buf, str, 1, &range, flags)
-              && range.rm_so == 0 && range.rm_eo == (int)strlen(str));
-    }
+  bool full_match(const char * str, int flags = 0) const;
 
   /// Return true if substring matches pattern, fill regmatch_t array.
-  bool execute(const char * str, unsigned nmatch, regmatch_t * pmatch, int flags = 0) const
-    { return !regexec(&m_regex_buf, str, nmatch, pmatch, flags); }
+  bool execute(const char * str, unsigned nmatch, regmatch_t * pmatch, int flags = 0) const;
 
 private:
   std::string m_pattern;
   int m_flags;
-  regex_t m_regex_buf;
+  mutable regex_t m_regex_buf; // Compiled on demand if m_prog is set
   std::string m_errmsg;
+  regex_fast_program * m_prog; // Fast matcher, shared by copies, 0 if not supported
 
   void free_buf();
   void copy(const regular_expression & x);
   bool compile();
+  bool compile_posix() const;
 };
 
 #ifdef _WIN32